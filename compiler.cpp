@@ -1,4 +1,5 @@
 #include "compiler.h"
+#include <algorithm>
 #include <stack>
 
 bool label_cmp(const Label& left, const Label& right) {
@@ -288,6 +289,26 @@ void Compiler::replace_type_literals() {
 	}
 }
 
+// param name becomes a placeholder token, names are stored in the order of the placeholders
+void Compiler::replace_params() {
+	for (ProgramCounterType i = 0; i < words.size(); i++) {
+		WordToken current_word_token = words[i];
+		try {
+			if (current_word_token.str == "param") {
+				if (i + 1 == words.size() || !utils::is_valid_word_prefix(words[i + 1].str.front())) {
+					throw std::runtime_error("Invalid parameter name");
+				}
+				std::string name = words[i + 1].str;
+				words[i].display_str = "param " + name;
+				words.erase(words.begin() + i + 1);
+				param_names.push_back(name);
+			}
+		} catch (std::exception exc) {
+			throw std::runtime_error("Line " + std::to_string(current_word_token.line) + ": " + std::string(exc.what()));
+		}
+	}
+}
+
 void Compiler::create_labels() {
 	for (ProgramCounterType i = 0; i < words.size(); i++) {
 		WordToken current_word_token = words[i];
@@ -340,20 +361,186 @@ void Compiler::create_tokens() {
 	}
 }
 
+std::vector<ProgramCounterType> Compiler::get_last_indices() {
+	struct OpenNode {
+		ProgramCounterType index;
+		ProgramCounterType args_left;
+	};
+	std::vector<ProgramCounterType> last_indices(tokens.size());
+	std::stack<OpenNode> parent_stack;
+	for (ProgramCounterType i = 0; i < tokens.size(); i++) {
+		ProgramCounterType arg_count = 0;
+		if (!tokens[i].is_num_or_ptr()) {
+			arg_count = get_arg_count(tokens[i].get_data_cast<InstructionDataType>());
+		}
+		if (arg_count > 0) {
+			parent_stack.push({ i, arg_count });
+			continue;
+		}
+		last_indices[i] = i;
+		bool end_end = tokens[i].str == "end";
+		while (!parent_stack.empty()) {
+			if (end_end) {
+				end_end = false;
+			} else if (--parent_stack.top().args_left > 0) {
+				break;
+			}
+			last_indices[parent_stack.top().index] = i;
+			parent_stack.pop();
+		}
+	}
+	return last_indices;
+}
+
+void Compiler::remove_tokens(const std::vector<bool>& removed) {
+	PointerDataType old_size = tokens.size();
+	std::vector<PointerDataType> new_indices(old_size + 1);
+	std::vector<Token> new_tokens;
+	for (PointerDataType i = 0; i < old_size; i++) {
+		new_indices[i] = new_tokens.size();
+		if (!removed[i]) {
+			new_tokens.push_back(tokens[i]);
+		}
+	}
+	new_indices[old_size] = new_tokens.size();
+	for (PointerDataType i = 0; i < old_size; i++) {
+		if (!removed[i] && tokens[i].is_ptr()) {
+			Token& new_token = new_tokens[new_indices[i]];
+			PointerDataType old_dst = utils::mod(i + tokens[i].get_data<PointerDataType>(), old_size + 1);
+			new_token.set_data<PointerDataType>(new_indices[old_dst] - new_indices[i]);
+			new_token.str = new_token.to_string();
+		}
+	}
+	tokens = new_tokens;
+}
+
+// Replaces subtrees of pure functions with literal arguments by their result.
+// Folding moves tokens and makes values appear in earlier iterations, so a subtree is kept as written when
+// - it is inside a q or a pointer points into it, a pointer at it would lose its target
+// - a number argument of another instruction, which could be a relative address, spans or reaches it
+// - any instruction above it is not a pure function, that instruction could modify or wait for it,
+//   or order its children by the iteration they finish in
+void Compiler::fold_constant_subtrees() {
+	std::vector<ProgramCounterType> last_indices = get_last_indices();
+	PointerDataType size = tokens.size();
+	auto is_pure = [&](PointerDataType index) {
+		return !tokens[index].is_num_or_ptr()
+			&& (Token::get_unary_func(tokens[index].str) || Token::get_binary_func(tokens[index].str));
+	};
+	std::vector<PointerDataType> parent_indices(size, -1);
+	std::vector<bool> pure_ancestors(size, true);
+	std::stack<PointerDataType> parent_stack;
+	for (PointerDataType i = 0; i < size; i++) {
+		while (!parent_stack.empty() && last_indices[parent_stack.top()] < i) {
+			parent_stack.pop();
+		}
+		if (!parent_stack.empty()) {
+			parent_indices[i] = parent_stack.top();
+			pure_ancestors[i] = pure_ancestors[parent_stack.top()] && is_pure(parent_stack.top());
+		}
+		if (last_indices[i] > i) {
+			parent_stack.push(i);
+		}
+	}
+	bool protect_all = false;
+	std::vector<PointerDataType> protect_delta(size + 2, 0);
+	auto protect = [&](PointerDataType begin, PointerDataType end) {
+		protect_delta[begin]++;
+		protect_delta[end + 1]--;
+	};
+	for (PointerDataType i = 0; i < size; i++) {
+		PointerDataType parent = parent_indices[i];
+		if (tokens[i].str == "q") {
+			protect(i, last_indices[i]);
+		} else if (tokens[i].is_ptr()) {
+			PointerDataType dst = utils::mod(i + tokens[i].get_data<PointerDataType>(), size + 1);
+			if (dst < size) {
+				protect(dst, last_indices[dst]);
+			}
+		} else if (
+			tokens[i].is_num() && Token::is_int_type(tokens[i].type) && parent >= 0 && !is_pure(parent)
+			&& !(get_node_flags(tokens[parent].get_data_cast<InstructionDataType>()) & NODE_CONTAINER)
+		) {
+			// offsets are taken from either the instruction or the argument, everything in between can be reached
+			PointerDataType offset = tokens[i].get_data_cast<PointerDataType>();
+			PointerDataType begin = std::min(i, parent) + std::min(offset, (PointerDataType)0);
+			PointerDataType end = std::max(i, parent) + std::max(offset, (PointerDataType)0);
+			if (begin < 0 || end >= size) {
+				// the address wraps around, any fold would move its target
+				protect_all = true;
+				break;
+			}
+			end = std::max({ end, (PointerDataType)last_indices[parent + offset], (PointerDataType)last_indices[i + offset] });
+			protect(begin, end);
+		}
+	}
+	if (protect_all) {
+		return;
+	}
+	std::vector<ProgramCounterType> protected_prefix(size + 1, 0);
+	PointerDataType protect_depth = 0;
+	for (ProgramCounterType i = 0; i < size; i++) {
+		protect_depth += protect_delta[i];
+		protected_prefix[i + 1] = protected_prefix[i] + (protect_depth > 0 ? 1 : 0);
+	}
+	auto is_protected = [&](ProgramCounterType begin, ProgramCounterType end) {
+		return protected_prefix[end + 1] - protected_prefix[begin] > 0;
+	};
+	std::vector<bool> removed(size, false);
+	std::vector<ProgramCounterType> live_tokens;
+	for (PointerDataType i = size - 1; i >= 0; i--) {
+		Token& current_token = tokens[i];
+		Token::UnaryFunc unary = nullptr;
+		Token::BinaryFunc binary = nullptr;
+		if (!current_token.is_num_or_ptr()) {
+			unary = Token::get_unary_func(current_token.str);
+			binary = Token::get_binary_func(current_token.str);
+		}
+		ProgramCounterType arg_count = unary ? 1 : binary ? 2 : 0;
+		bool foldable = arg_count > 0 && live_tokens.size() >= arg_count && pure_ancestors[i] && !is_protected(i, last_indices[i]);
+		for (ProgramCounterType arg_i = 0; foldable && arg_i < arg_count; arg_i++) {
+			foldable = tokens[live_tokens[live_tokens.size() - 1 - arg_i]].is_num();
+		}
+		if (foldable) {
+			Token& first = tokens[live_tokens[live_tokens.size() - 1]];
+			Token result = unary ? unary(first) : binary(first, tokens[live_tokens[live_tokens.size() - 2]]);
+			result.orig_str = result.str;
+			current_token = result;
+			for (ProgramCounterType arg_i = 0; arg_i < arg_count; arg_i++) {
+				removed[live_tokens.back()] = true;
+				live_tokens.pop_back();
+			}
+		}
+		live_tokens.push_back(i);
+	}
+	remove_tokens(removed);
+}
+
 std::vector<Token> Compiler::compile(std::string str) {
 	try {
 		tokenize(str);
 		replace_macros();
 		replace_string_literals();
 		replace_type_literals();
+		replace_params();
 		create_labels();
 		create_tokens();
+		if (fold_constants) {
+			fold_constant_subtrees();
+		}
+		if (fuse_instructions) {
+			Token::mark_fused(tokens, 0, tokens.size());
+		}
 		return tokens;
 	} catch (std::exception exc) {
 		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
 	}
 }
 
+const std::vector<std::string>& Compiler::get_param_names() {
+	return param_names;
+}
+
 TreeToken::TreeToken() {}
 
 TreeToken::TreeToken(std::string str, ProgramCounterType first_index) {
@@ -52,13 +52,18 @@ struct TreeToken {
 
 class Compiler {
 public:
+	bool fold_constants = false;
+	bool fuse_instructions = false;
+
 	std::vector<Token> compile(std::string str);
+	const std::vector<std::string>& get_param_names();
 
 private:
 	std::vector<WordToken> words;
 	MacroSet macros = MacroSet(macro_cmp);
 	LabelSet labels = LabelSet(label_cmp);
 	std::vector<Token> tokens;
+	std::vector<std::string> param_names;
 
 	std::vector<WordToken> get_subtree(ProgramCounterType index, ProgramCounterType& last_index);
 	void expand_macro(ProgramCounterType index, Macro& macro);
@@ -66,7 +71,11 @@ private:
 	void replace_macros();
 	void replace_string_literals();
 	void replace_type_literals();
+	void replace_params();
 	void create_labels();
 	void create_tokens();
+	std::vector<ProgramCounterType> get_last_indices();
+	void remove_tokens(const std::vector<bool>& removed);
+	void fold_constant_subtrees();
 
 };
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "filemap.h"
+#include <algorithm>
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+FileMapping::FileMapping(std::string path) : path(path) {
+	file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		file_handle = nullptr;
+		throw std::runtime_error("Cannot open file: " + path);
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size)) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("Cannot get file size: " + path);
+	}
+	length = file_size.QuadPart;
+	if (length == 0) {
+		return;
+	}
+	mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping_handle) {
+		CloseHandle(file_handle);
+		throw std::runtime_error("Cannot map file: " + path);
+	}
+	begin = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+	if (!begin) {
+		CloseHandle(mapping_handle);
+		CloseHandle(file_handle);
+		throw std::runtime_error("Cannot map file: " + path);
+	}
+}
+
+FileMapping::~FileMapping() {
+	if (begin) {
+		UnmapViewOfFile(begin);
+	}
+	if (mapping_handle) {
+		CloseHandle(mapping_handle);
+	}
+	if (file_handle) {
+		CloseHandle(file_handle);
+	}
+}
+
+#else
+
+FileMapping::FileMapping(std::string path) : path(path) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Cannot open file: " + path);
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		close(fd);
+		throw std::runtime_error("Cannot get file size: " + path);
+	}
+	length = file_stat.st_size;
+	if (length > 0) {
+		void* address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Cannot map file: " + path);
+		}
+		madvise(address, length, MADV_SEQUENTIAL);
+		begin = static_cast<const unsigned char*>(address);
+	}
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+FileMapping::~FileMapping() {
+	if (begin) {
+		munmap(const_cast<unsigned char*>(begin), length);
+	}
+}
+
+#endif
+
+const unsigned char* FileMapping::data() const {
+	return begin;
+}
+
+ProgramCounterType FileMapping::size() const {
+	return length;
+}
+
+FileView::FileView(std::shared_ptr<FileMapping> mapping, ProgramCounterType offset, ProgramCounterType size)
+	: mapping(mapping), offset(offset), view_size(size) { }
+
+std::shared_ptr<FileView> FileView::open(std::string path) {
+	std::shared_ptr<FileMapping> mapping = std::make_shared<FileMapping>(path);
+	return std::make_shared<FileView>(mapping, 0, mapping->size());
+}
+
+ProgramCounterType FileView::size() const {
+	return view_size;
+}
+
+Token FileView::get(ProgramCounterType index) const {
+	Token result;
+	result.type = type_int32;
+	result.set_data<Int32Type>(mapping->data()[offset + index]);
+	result.str = result.to_string();
+	return result;
+}
+
+std::shared_ptr<FileView> FileView::chunk(ProgramCounterType chunk_offset, ProgramCounterType chunk_size) const {
+	chunk_offset = std::min(chunk_offset, view_size);
+	chunk_size = std::min(chunk_size, view_size - chunk_offset);
+	return std::make_shared<FileView>(mapping, offset + chunk_offset, chunk_size);
+}
+
+std::string FileView::name() const {
+	return "file";
+}
+
+std::shared_ptr<TokenObject> FileView::clone() const {
+	return std::make_shared<FileView>(mapping, offset, view_size);
+}
+
+bool FileView::equals(const TokenObject& other) const {
+	const FileView* other_view = dynamic_cast<const FileView*>(&other);
+	return other_view && other_view->mapping == mapping && other_view->offset == offset && other_view->view_size == view_size;
+}
+
+std::string FileView::to_string() const {
+	return name() + "<" + mapping->path + ">{" + std::to_string(offset) + ", " + std::to_string(view_size) + "}";
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "object.h"
+
+// Read-only memory mapping of a whole file, pages are loaded by the OS only when they are read.
+class FileMapping {
+public:
+	const std::string path;
+	FileMapping(std::string path);
+	~FileMapping();
+	FileMapping(const FileMapping&) = delete;
+	FileMapping& operator=(const FileMapping&) = delete;
+	const unsigned char* data() const;
+	ProgramCounterType size() const;
+
+private:
+	const unsigned char* begin = nullptr;
+	ProgramCounterType length = 0;
+#ifdef _WIN32
+	void* file_handle = nullptr;
+	void* mapping_handle = nullptr;
+#endif
+
+};
+
+// Range of bytes of a mapped file, bytes become tokens only when they are read by an instruction.
+// Views of the same file share the mapping, so copying a view does not copy the file.
+class FileView : public TokenObject {
+public:
+	FileView(std::shared_ptr<FileMapping> mapping, ProgramCounterType offset, ProgramCounterType size);
+	static std::shared_ptr<FileView> open(std::string path);
+	ProgramCounterType size() const;
+	Token get(ProgramCounterType index) const;
+	std::shared_ptr<FileView> chunk(ProgramCounterType offset, ProgramCounterType size) const;
+	std::string name() const override;
+	std::shared_ptr<TokenObject> clone() const override;
+	bool equals(const TokenObject& other) const override;
+	std::string to_string() const override;
+
+private:
+	std::shared_ptr<FileMapping> mapping;
+	ProgramCounterType offset;
+	ProgramCounterType view_size;
+
+};
@@ -0,0 +1,92 @@
+#include "heap.h"
+#include <cstring>
+
+#define HEAP_TYPE_CASE(TP1, TP2, FUNC) \
+	case TP1: \
+		{ \
+			typedef TP2 elem_t; \
+			FUNC \
+		} \
+		break;
+
+#define HEAP_TYPE_SWITCH(TYPE, FUNC) \
+	switch (TYPE) { \
+		HEAP_TYPE_CASE(type_int32, Int32Type, FUNC) \
+		HEAP_TYPE_CASE(type_int64, Int64Type, FUNC) \
+		HEAP_TYPE_CASE(type_uint32, Uint32Type, FUNC) \
+		HEAP_TYPE_CASE(type_uint64, Uint64Type, FUNC) \
+		HEAP_TYPE_CASE(type_float, FloatDataType, FUNC) \
+		HEAP_TYPE_CASE(type_double, DoubleDataType, FUNC) \
+		default: \
+			throw std::runtime_error("Invalid heap value type: " + std::to_string(TYPE)); \
+	}
+
+Heap::Address Heap::malloc(ProgramCounterType size) {
+	ProgramCounterType size_class = MIN_SIZE_CLASS;
+	while (((ProgramCounterType)1 << size_class) < size + sizeof(BlockHeader)) {
+		size_class++;
+		if (size_class > MAX_SIZE_CLASS) {
+			throw std::runtime_error("Heap block is too large: " + std::to_string(size));
+		}
+	}
+	Address block;
+	if (!free_lists[size_class].empty()) {
+		block = free_lists[size_class].back();
+		free_lists[size_class].pop_back();
+	} else {
+		block = memory.size();
+		memory.resize(memory.size() + ((ProgramCounterType)1 << size_class));
+	}
+	BlockHeader header = { (Uint32Type)size_class, 1 };
+	std::memcpy(&memory[block], &header, sizeof(BlockHeader));
+	allocated_size += (ProgramCounterType)1 << size_class;
+	live_blocks[block + sizeof(BlockHeader)] = (Uint32Type)size_class;
+	return block + sizeof(BlockHeader);
+}
+
+void Heap::free(Address address) {
+	if (address == 0) {
+		return;
+	}
+	// the bytes before any other address can look like a header, as the program writes them,
+	// and so can the header itself, the size class is taken from live_blocks
+	auto it = live_blocks.find(address);
+	if (it == live_blocks.end()) {
+		throw std::runtime_error("Invalid heap address in free: " + std::to_string(address));
+	}
+	BlockHeader header = { it->second, 0 };
+	live_blocks.erase(it);
+	std::memcpy(&memory[address - sizeof(BlockHeader)], &header, sizeof(BlockHeader));
+	free_lists[header.size_class].push_back(address - sizeof(BlockHeader));
+	allocated_size -= (ProgramCounterType)1 << header.size_class;
+}
+
+Token Heap::load(Address address, token_type type) {
+	Token result;
+	result.type = type;
+	HEAP_TYPE_SWITCH(type,
+		elem_t value;
+		std::memcpy(&value, access(address, sizeof(elem_t)), sizeof(elem_t));
+		result.set_data<elem_t>(value);
+	)
+	result.str = result.to_string();
+	return result;
+}
+
+void Heap::store(Address address, Token value) {
+	HEAP_TYPE_SWITCH(value.type,
+		elem_t data = value.get_data<elem_t>();
+		std::memcpy(access(address, sizeof(elem_t)), &data, sizeof(elem_t));
+	)
+}
+
+ProgramCounterType Heap::get_allocated_size() const {
+	return allocated_size;
+}
+
+unsigned char* Heap::access(Address address, ProgramCounterType size) {
+	if (address < (Address)sizeof(BlockHeader) || address + size > memory.size()) {
+		throw std::runtime_error("Heap access out of bounds: " + std::to_string(address));
+	}
+	return &memory[address];
+}
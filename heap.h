@@ -0,0 +1,33 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "token.h"
+
+// Byte addressable memory owned by the interpreter.
+// Blocks are rounded up to a power of two size class, freed blocks are reused by the same class.
+class Heap {
+public:
+	typedef Int64Type Address;
+	Address malloc(ProgramCounterType size);
+	void free(Address address);
+	Token load(Address address, token_type type);
+	void store(Address address, Token value);
+	ProgramCounterType get_allocated_size() const;
+
+private:
+	// every block starts with a header, so 0 is never a valid address
+	struct BlockHeader {
+		Uint32Type size_class;
+		Uint32Type allocated;
+	};
+	static const ProgramCounterType MIN_SIZE_CLASS = 4;
+	static const ProgramCounterType MAX_SIZE_CLASS = 40;
+	std::vector<unsigned char> memory;
+	std::vector<std::vector<Address>> free_lists = std::vector<std::vector<Address>>(MAX_SIZE_CLASS + 1);
+	ProgramCounterType allocated_size = 0;
+	// size classes of the addresses returned by malloc and not freed yet
+	std::unordered_map<Address, Uint32Type> live_blocks;
+	unsigned char* access(Address address, ProgramCounterType size);
+
+};
@@ -0,0 +1,107 @@
+#include "input.h"
+#include <algorithm>
+#include <memory>
+
+// Blocks until at least one byte is available, returns early after a newline so lines are not delayed.
+InputBuffer::Source InputBuffer::stream_source(std::istream& stream) {
+	return [&stream](char* data, ProgramCounterType size) -> Int64Type {
+		ProgramCounterType count = 0;
+		char c;
+		while (count < size && stream.get(c)) {
+			data[count++] = c;
+			if (c == '\n') {
+				break;
+			}
+		}
+		return count == 0 && !stream ? -1 : count;
+	};
+}
+
+InputBuffer::Source InputBuffer::string_source(std::string str) {
+	std::shared_ptr<ProgramCounterType> pos = std::make_shared<ProgramCounterType>(0);
+	return [str, pos](char* data, ProgramCounterType size) -> Int64Type {
+		if (*pos == str.size()) {
+			return -1;
+		}
+		ProgramCounterType count = std::min(size, str.size() - *pos);
+		str.copy(data, count, *pos);
+		*pos += count;
+		return count;
+	};
+}
+
+void InputBuffer::set_source(Source source) {
+	this->source = source;
+	source_ended = !source;
+}
+
+// Returns false if fewer than count bytes are available and more may arrive later.
+// Reads are limited to the buffer capacity, at the end of input the remaining bytes are returned.
+bool InputBuffer::read(ProgramCounterType count, std::string& result) {
+	ProgramCounterType size = std::min(count, capacity);
+	fill(size);
+	if (buffered_size() < size && !source_ended) {
+		return false;
+	}
+	result = take(std::min(size, buffered_size()));
+	return true;
+}
+
+// Lines longer than the buffer capacity are returned in parts.
+bool InputBuffer::read_line(std::string& result) {
+	while (true) {
+		ProgramCounterType newline_pos = buffer.find('\n', buffer_begin);
+		if (newline_pos != std::string::npos) {
+			result = take(newline_pos - buffer_begin, 1);
+			return true;
+		}
+		ProgramCounterType prev_size = buffered_size();
+		if (prev_size >= capacity || source_ended) {
+			result = take(std::min(prev_size, capacity));
+			return true;
+		}
+		fill(prev_size + 1);
+		if (buffered_size() == prev_size && !source_ended) {
+			return false;
+		}
+	}
+}
+
+// Returns false if it is not known yet whether more input will arrive.
+bool InputBuffer::at_end(bool& result) {
+	fill(1);
+	if (buffered_size() == 0 && !source_ended) {
+		return false;
+	}
+	result = buffered_size() == 0;
+	return true;
+}
+
+ProgramCounterType InputBuffer::buffered_size() const {
+	return buffer.size() - buffer_begin;
+}
+
+void InputBuffer::fill(ProgramCounterType min_size) {
+	min_size = std::min(min_size, capacity);
+	while (!source_ended && buffered_size() < min_size) {
+		if (buffer_begin > 0) {
+			buffer.erase(0, buffer_begin);
+			buffer_begin = 0;
+		}
+		ProgramCounterType old_size = buffer.size();
+		buffer.resize(capacity);
+		Int64Type count = source(&buffer[old_size], capacity - old_size);
+		buffer.resize(old_size + std::max<Int64Type>(count, 0));
+		if (count < 0) {
+			source_ended = true;
+		} else if (count == 0) {
+			break;
+		}
+	}
+}
+
+std::string InputBuffer::take(ProgramCounterType size, ProgramCounterType skip) {
+	std::string result = buffer.substr(buffer_begin, size);
+	buffer_begin += size + skip;
+	return result;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+#include <istream>
+#include <string>
+#include "types.h"
+
+// Bounded buffer between a host input source and the read instructions.
+// The source is only asked for as many bytes as fit in the buffer, so a faster producer is held back.
+class InputBuffer {
+public:
+	// writes up to size bytes to data and returns their count,
+	// 0 if no data is available yet, -1 at the end of input
+	typedef std::function<Int64Type(char* data, ProgramCounterType size)> Source;
+	ProgramCounterType capacity = 4096;
+	static Source stream_source(std::istream& stream);
+	static Source string_source(std::string str);
+	void set_source(Source source);
+	bool read(ProgramCounterType count, std::string& result);
+	bool read_line(std::string& result);
+	bool at_end(bool& result);
+
+private:
+	Source source;
+	std::string buffer;
+	ProgramCounterType buffer_begin = 0;
+	bool source_ended = true;
+	ProgramCounterType buffered_size() const;
+	void fill(ProgramCounterType min_size);
+	std::string take(ProgramCounterType size, ProgramCounterType skip = 0);
+
+};
@@ -4,19 +4,38 @@ bool operator<(const InstructionDef& left, const InstructionDef& right) {
 	return left.str < right.str;
 }
 
+static std::vector<InstructionDef>& registered_instructions() {
+	static std::vector<InstructionDef> instruction_list;
+	return instruction_list;
+}
+
+static const InstructionDef& get_instruction_def(InstructionDataType index) {
+	if (index < INSTRUCTION_LIST.size()) {
+		return INSTRUCTION_LIST[index];
+	}
+	return registered_instructions()[index - INSTRUCTION_LIST.size()];
+}
+
 InstructionInfo get_instruction_info(std::string token) {
 	try {
-		auto it = std::find_if(INSTRUCTION_LIST.begin(), INSTRUCTION_LIST.end(),
-			[&](InstructionDef def) {
-				return def.str == token;
+		auto find_in = [&](const std::vector<InstructionDef>& instruction_list, int index_offset) {
+			auto it = std::find_if(instruction_list.begin(), instruction_list.end(),
+				[&](const InstructionDef& def) {
+					return def.str == token;
+				}
+			);
+			if (it == instruction_list.end()) {
+				return InstructionInfo();
 			}
-		);
-		if (it == INSTRUCTION_LIST.end()) {
-			return InstructionInfo();
+			const InstructionDef def = *it;
+			int index = index_offset + (it - instruction_list.begin());
+			InstructionInfo info(def.str, def.arg_count, index);
+			return info;
+		};
+		InstructionInfo info = find_in(INSTRUCTION_LIST, 0);
+		if (info.index < 0) {
+			info = find_in(registered_instructions(), INSTRUCTION_LIST.size());
 		}
-		const InstructionDef def = *it;
-		int index = it - INSTRUCTION_LIST.begin();
-		InstructionInfo info(def.str, def.arg_count, index);
 		return info;
 	} catch (std::exception exc) {
 		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
@@ -24,12 +43,60 @@ InstructionInfo get_instruction_info(std::string token) {
 }
 
 InstructionInfo get_instruction_info(int index) {
-	if (index < 0 || index >= INSTRUCTION_LIST.size()) {
+	if (index < 0 || index >= INSTRUCTION_LIST.size() + registered_instructions().size()) {
 		return InstructionInfo();
 	}
-	return InstructionInfo(INSTRUCTION_LIST[index], index);
+	return InstructionInfo(get_instruction_def(index), index);
 }
 
 ProgramCounterType get_arg_count(InstructionDataType index) {
-	return INSTRUCTION_LIST[index].arg_count;
+	return get_instruction_def(index).arg_count;
+}
+
+std::string get_instruction_str(InstructionDataType index) {
+	return get_instruction_def(index).str;
+}
+
+InstructionDataType register_instruction(std::string str, ProgramCounterType arg_count) {
+	if (get_instruction_info(str).index >= 0) {
+		throw std::runtime_error("Instruction already exists: " + str);
+	}
+	registered_instructions().push_back(InstructionDef(str, arg_count));
+	return INSTRUCTION_LIST.size() + registered_instructions().size() - 1;
+}
+
+NodeFlags get_node_flags(InstructionDataType index) {
+	if (index >= INSTRUCTION_LIST.size()) {
+		return 0;
+	}
+	static const std::vector<NodeFlags> flags_list = []() {
+		std::vector<NodeFlags> result;
+		for (const InstructionDef& def : INSTRUCTION_LIST) {
+			NodeFlags flags = 0;
+			if (def.str == "list" || def.str == "seq" || def.str == "ulist" || def.str == "useq") {
+				flags |= NODE_CONTAINER;
+			}
+			if (def.str == "list" || def.str == "seq") {
+				flags |= NODE_ORDERED;
+			}
+			if (def.str == "seq" || def.str == "useq") {
+				flags |= NODE_SEQ;
+			}
+			if (def.str == "q") {
+				flags |= NODE_QUOTE;
+			}
+			if (def.str == "end") {
+				flags |= NODE_END;
+			}
+			if (def.str == "if") {
+				flags |= NODE_IF;
+			}
+			if (def.str == "block") {
+				flags |= NODE_BLOCK;
+			}
+			result.push_back(flags);
+		}
+		return result;
+	}();
+	return flags_list[index];
 }
@@ -72,6 +72,7 @@ const std::vector<InstructionDef> INSTRUCTION_LIST =
 	InstructionDef("seq", (ProgramCounterType)-1),
 	InstructionDef("ulist", (ProgramCounterType)-1),
 	InstructionDef("useq", (ProgramCounterType)-1),
+	InstructionDef("block", (ProgramCounterType)-1),
 	InstructionDef("end", 0),
 	InstructionDef("box", 2),
 	InstructionDef("unbox", 1),
@@ -79,8 +80,64 @@ const std::vector<InstructionDef> INSTRUCTION_LIST =
 	InstructionDef("cast", 2),
 	InstructionDef("print", 1),
 	InstructionDef("str", 1),
+	InstructionDef("pack", 1),
+	InstructionDef("unpack", 1),
+	InstructionDef("freeze", 1),
+	InstructionDef("alen", 1),
+	InstructionDef("aget", 2),
+	InstructionDef("aset", 3),
+	InstructionDef("ains", 3),
+	InstructionDef("adel", 2),
+	InstructionDef("sum", 1),
+	InstructionDef("min", 1),
+	InstructionDef("max", 1),
+	InstructionDef("dot", 2),
+	InstructionDef("len", 1),
+	InstructionDef("getsize", 1),
+	InstructionDef("find", 2),
+	InstructionDef("slice", 3),
+	InstructionDef("concat", 2),
+	InstructionDef("reverse", 1),
+	InstructionDef("sort", 1),
+	InstructionDef("file", 1),
+	InstructionDef("read", 1),
+	InstructionDef("readline", 0),
+	InstructionDef("eof", 0),
+	InstructionDef("chunk", 3),
+	InstructionDef("map", 0),
+	InstructionDef("param", 0),
+	InstructionDef("mput", 3),
+	InstructionDef("mget", 2),
+	InstructionDef("mdel", 2),
+	InstructionDef("mhas", 2),
+	InstructionDef("malloc", 1),
+	InstructionDef("free", 1),
+	InstructionDef("load", 2),
+	InstructionDef("store", 2),
+	InstructionDef("next", 1),
+	InstructionDef("prev", 1),
+	InstructionDef("up", 1),
+	InstructionDef("down", 1),
+	InstructionDef("getaddr", 1),
 };
 
+// Structural kind of an instruction, so predicates on nodes are bit tests instead of string compares.
+enum NodeFlag {
+	NODE_CONTAINER = 1 << 0, // list, seq, ulist, useq
+	NODE_ORDERED = 1 << 1, // list, seq
+	NODE_SEQ = 1 << 2, // seq, useq
+	NODE_QUOTE = 1 << 3,
+	NODE_END = 1 << 4,
+	NODE_IF = 1 << 5,
+	NODE_BLOCK = 1 << 6,
+};
+typedef unsigned NodeFlags;
+
 InstructionInfo get_instruction_info(std::string token);
 InstructionInfo get_instruction_info(int index);
 ProgramCounterType get_arg_count(InstructionDataType index);
+NodeFlags get_node_flags(InstructionDataType index);
+std::string get_instruction_str(InstructionDataType index);
+// Instructions registered by the embedding host get indices after INSTRUCTION_LIST,
+// they have to be registered before the programs that use them are compiled.
+InstructionDataType register_instruction(std::string str, ProgramCounterType arg_count);
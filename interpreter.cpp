@@ -1,4 +1,5 @@
 #include "interpreter.h"
+#include "simd.h"
 
 Interpreter::NewPointersEntry::NewPointersEntry(PointerDataType index, PointerDataType pointer) {
 	this->index = index;
@@ -11,14 +12,38 @@ Interpreter::DeleteOp::DeleteOp(ProgramCounterType pos_begin, ProgramCounterType
 	this->priority = priority;
 }
 
-Interpreter::InsertOp::InsertOp(ProgramCounterType dst_pos, std::vector<Token> insert_tokens) {
+Interpreter::TokenSpan::TokenSpan() { }
+
+Interpreter::TokenSpan::TokenSpan(std::vector<Token>* source, ProgramCounterType begin, ProgramCounterType end) {
+	this->source = source;
+	this->begin = begin;
+	this->end = end;
+}
+
+ProgramCounterType Interpreter::TokenSpan::size() const {
+	return end - begin;
+}
+
+Token& Interpreter::TokenSpan::operator[](ProgramCounterType index) const {
+	return (*source)[begin + index];
+}
+
+std::vector<Token>::iterator Interpreter::TokenSpan::tokens_begin() const {
+	return source->begin() + begin;
+}
+
+std::vector<Token>::iterator Interpreter::TokenSpan::tokens_end() const {
+	return source->begin() + end;
+}
+
+Interpreter::InsertOp::InsertOp(ProgramCounterType dst_pos, TokenSpan insert_tokens) {
 	this->src_pos = -1;
 	this->dst_pos = dst_pos;
 	this->insert_tokens = insert_tokens;
 	this->recalc_pointers = false;
 }
 
-Interpreter::InsertOp::InsertOp(ProgramCounterType src_pos, ProgramCounterType dst_pos, std::vector<Token> insert_tokens) {
+Interpreter::InsertOp::InsertOp(ProgramCounterType src_pos, ProgramCounterType dst_pos, TokenSpan insert_tokens) {
 	this->src_pos = src_pos;
 	this->dst_pos = dst_pos;
 	this->insert_tokens = insert_tokens;
@@ -27,7 +52,7 @@ Interpreter::InsertOp::InsertOp(ProgramCounterType src_pos, ProgramCounterType d
 
 Interpreter::ReplaceOp::ReplaceOp(
 	ProgramCounterType dst_begin, ProgramCounterType dst_end,
-	ProgramCounterType src_begin, std::vector<Token> src_tokens
+	ProgramCounterType src_begin, TokenSpan src_tokens
 ) {
 	this->dst_begin = dst_begin;
 	this->dst_end = dst_end;
@@ -54,8 +79,83 @@ Interpreter::MoveReplaceOp::MoveReplaceOp(
 	this->new_end = new_end;
 }
 
+Interpreter::ObjectOp::ObjectOp(std::shared_ptr<TokenObject> object, std::function<void(TokenObject&)> write) {
+	this->object = object;
+	this->write = write;
+}
+
 Interpreter::Interpreter(std::string str) {
-	tokens = Compiler().compile(str);
+	Compiler compiler;
+	tokens = compiler.compile(str);
+	param_names = compiler.get_param_names();
+}
+
+Interpreter::Interpreter(std::string str, Compiler compiler) {
+	tokens = compiler.compile(str);
+	param_names = compiler.get_param_names();
+}
+
+// Runs the contents of a block one iteration per execute, nested blocks run on the thread of the block.
+Interpreter::Interpreter(std::vector<Token> tokens, const Interpreter& parent) {
+	this->tokens = tokens;
+	fuse_instructions = parent.fuse_instructions;
+	eager_reduction = parent.eager_reduction;
+	jit = parent.jit;
+	jit_verify = parent.jit_verify;
+	jit_cache.hot_count = parent.jit_cache.hot_count;
+	tracer = parent.tracer;
+	max_iterations = 1;
+	block_threads = 1;
+}
+
+void Interpreter::bind(std::string name, Token value) {
+	bind_subtree(name, { value });
+}
+
+void Interpreter::bind_list(std::string name, std::vector<Token> elements) {
+	elements.insert(elements.begin(), Token("list"));
+	elements.push_back(Token("end"));
+	bind_subtree(name, elements);
+}
+
+// Replaces every placeholder of the parameter, pointers are adjusted for the size change,
+// so nothing has to be compiled again.
+void Interpreter::bind_subtree(std::string name, std::vector<Token> subtree) {
+	try {
+		bool found = false;
+		ProgramCounterType param_i = 0;
+		for (ProgramCounterType token_i = 0; token_i < tokens.size(); token_i++) {
+			if (tokens[token_i].type != type_instr || tokens[token_i].str != "param") {
+				continue;
+			}
+			if (param_names[param_i] != name) {
+				param_i++;
+				continue;
+			}
+			PointerDataType pos = token_i;
+			PointerDataType delta = (PointerDataType)subtree.size() - 1;
+			auto new_index = [&](PointerDataType index) { return index <= pos ? index : index + delta; };
+			for (PointerDataType ptr_i = 0; ptr_i < (PointerDataType)tokens.size(); ptr_i++) {
+				Token& current_token = tokens[ptr_i];
+				if (current_token.is_ptr()) {
+					PointerDataType target = ptr_i + current_token.get_data<PointerDataType>();
+					current_token.set_data<PointerDataType>(new_index(target) - new_index(ptr_i));
+					current_token.str = current_token.to_string();
+				}
+			}
+			tokens.erase(tokens.begin() + pos);
+			tokens.insert(tokens.begin() + pos, subtree.begin(), subtree.end());
+			update_fused_marks(pos, pos + subtree.size());
+			param_names.erase(param_names.begin() + param_i);
+			token_i += subtree.size() - 1;
+			found = true;
+		}
+		if (!found) {
+			throw std::runtime_error("Unknown parameter: " + name);
+		}
+	} catch (std::exception exc) {
+		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
+	}
 }
 
 void Interpreter::print_tokens(std::vector<Token>& token_list, bool print_program_counter) {
@@ -81,6 +181,8 @@ void Interpreter::print_nodes() {
 std::vector<Token> Interpreter::execute() {
 	try {
 		prev_tokens = tokens;
+		reset_state_hash();
+		ProgramCounterType gc_iteration = 0;
 		if (print_iterations) {
 			std::cout << "Iteration *: ";
 			print_tokens(tokens, false);
@@ -89,11 +191,17 @@ std::vector<Token> Interpreter::execute() {
 			if (print_iterations) {
 				std::cout << "Iteration " << iteration << ": ";
 			}
+			trace::Scope iteration_scope(tracer.get(), "iteration", "iteration");
+			iteration_scope.arg("iteration", iteration);
 			ProgramCounterType steps = 0;
 			reset_index_shift();
 			local_print_buffer = "";
+			waiting_for_input = false;
+			block_list.clear();
+			trace::Scope parse_scope(tracer.get(), "parse", "phase");
 			parse(0, false);
 			prev_tokens = tokens;
+			parse_scope.end();
 			auto jump_to_end = [&]() {
 				Token& seq_node = prev_tokens[scope_list.back().pos];
 				program_counter = seq_node.last_index;
@@ -115,23 +223,29 @@ std::vector<Token> Interpreter::execute() {
 			auto try_exec_silent = [&]() {
 				try_execute_func_instruction();
 			};
+			trace::Scope sweep_scope(tracer.get(), "sweep", "phase");
 			for (program_counter = 0; program_counter < prev_tokens.size(); program_counter++) {
 				Token& current_token = prev_tokens[program_counter];
-				if (current_token.is_num_or_ptr()) {
-					// skipping
+				if (current_token.is_value()) {
+					// values never fire, so the whole run of values is skipped
+					program_counter = current_token.next_instruction_index - 1;
 				} else if (parent_is_seq_or_useq() && scope_list.back().instruction_executed) {
 					exit_parent();
+				} else if (current_token.node_flags & NODE_BLOCK) {
+					// contents are run by exec_blocks after the sweep
+					block_list.push_back(program_counter);
+					program_counter = current_token.last_index;
 				} else if (current_token.is_container_header()) {
 					scope_list.push_back({ program_counter, false });
 					try_exec_silent();
-				} else if (current_token.str == "end") {
+				} else if (current_token.node_flags & NODE_END) {
 					if (parent_is_ulist_or_useq()) {
 						try_exec_normal();
 					} else {
 						try_exec_silent();
 					}
 					scope_list.pop_back();
-				} else if (current_token.str == "q") {
+				} else if (current_token.node_flags & NODE_QUOTE) {
 					try_exec_silent();
 				} else {
 					if (parent_is_container(program_counter, false)) {
@@ -142,11 +256,17 @@ std::vector<Token> Interpreter::execute() {
 				}
 				steps++;
 			}
+			sweep_scope.arg("steps", steps);
+			sweep_scope.end();
+			exec_blocks();
 			exec_pending_ops();
+			iteration_scope.arg("tokens", tokens.size());
 			if (print_iterations) {
 				print_tokens(tokens, false);
 			}
-			global_print_buffer += local_print_buffer;
+			if (store_print_buffer) {
+				global_print_buffer += local_print_buffer;
+			}
 			if (print_buffer_enabled && local_print_buffer.size() > 0) {
 				if (print_iterations) {
 					std::cout << "Print: ";
@@ -155,10 +275,32 @@ std::vector<Token> Interpreter::execute() {
 				if (print_iterations && !utils::is_newline(local_print_buffer.back())) {
 					std::cout << "\n";
 				}
+				std::cout.flush();
+			}
+			tokens_changed = !(tokens == prev_tokens);
+			if (waiting_for_input) {
+				continue;
 			}
-			if (tokens == prev_tokens) {
+			if (!tokens_changed && object_ops.empty()) {
 				break;
 			}
+			if (detect_cycles && find_cycle(iteration)) {
+				if (tracer) {
+					tracer->instant("cycle detected", "cycle", "period", cycle_length);
+				}
+				throw std::runtime_error(
+					"Cycle detected: period " + std::to_string(cycle_length)
+					+ ", entered at iteration " + std::to_string(cycle_entry_iteration)
+				);
+			}
+			if (collect_garbage && (iteration + 1 - gc_iteration >= gc_interval || tokens.size() > gc_token_threshold)) {
+				gc_iteration = iteration + 1;
+				ProgramCounterType collected = collect_unreachable();
+				if (print_iterations && collected > 0) {
+					std::cout << "Collected " << collected << " tokens: ";
+					print_tokens(tokens, false);
+				}
+			}
 		}
 		return tokens;
 	} catch (std::exception exc) {
@@ -166,61 +308,178 @@ std::vector<Token> Interpreter::execute() {
 	}
 }
 
+// An instruction that could not execute is not tried again until something in its subtree changes,
+// readiness of every instruction depends only on its own arguments.
+// Instructions waiting for input are the exception and are tried every iteration.
 bool Interpreter::try_execute_func_instruction() {
+	Token& node = prev_tokens[program_counter];
+	if (node.blocked && !node.subtree_changed) {
+		return false;
+	}
+	bool prev_waiting_for_input = waiting_for_input;
+	waiting_for_input = false;
+	ProgramCounterType node_index = program_counter;
+	bool executed = dispatch_instruction();
+	tokens[node_index].blocked = !executed && !waiting_for_input;
+	waiting_for_input = waiting_for_input || prev_waiting_for_input;
+	return executed;
+}
+
+bool Interpreter::dispatch_instruction() {
 	Token current_token = rel_token(prev_tokens, 0);
-	if (current_token.str == "add") {
-		return binary_func([](Token a, Token b) { return Token::add(a, b); });
-	} else if (current_token.str == "sub") {
-		return binary_func([](Token a, Token b) { return Token::sub(a, b); });
-	} else if (current_token.str == "mul") {
-		return binary_func([](Token a, Token b) { return Token::mul(a, b); });
-	} else if (current_token.str == "div") {
-		return binary_func([](Token a, Token b) { return Token::div(a, b); });
-	} else if (current_token.str == "mod") {
-		return binary_func([](Token a, Token b) { return Token::mod(a, b); });
-	} else if (current_token.str == "pow") {
-		return binary_func([](Token a, Token b) { return Token::pow(a, b); });
-	} else if (current_token.str == "log") {
-		return unary_func([](Token a) { return Token::log(a); });
-	} else if (current_token.str == "log2") {
-		return unary_func([](Token a) { return Token::log2(a); });
-	} else if (current_token.str == "sin") {
-		return unary_func([](Token a) { return Token::sin(a); });
-	} else if (current_token.str == "cos") {
-		return unary_func([](Token a) { return Token::cos(a); });
-	} else if (current_token.str == "tan") {
-		return unary_func([](Token a) { return Token::tan(a); });
-	} else if (current_token.str == "asin") {
-		return unary_func([](Token a) { return Token::asin(a); });
-	} else if (current_token.str == "acos") {
-		return unary_func([](Token a) { return Token::acos(a); });
-	} else if (current_token.str == "atan") {
-		return unary_func([](Token a) { return Token::atan(a); });
-	} else if (current_token.str == "atan2") {
-		return binary_func([](Token a, Token b) { return Token::atan2(a, b); });
-	} else if (current_token.str == "floor") {
-		return unary_func([](Token a) { return Token::floor(a); });
-	} else if (current_token.str == "ceil") {
-		return unary_func([](Token a) { return Token::ceil(a); });
-	} else if (current_token.str == "cmp") {
-		return binary_func([](Token a, Token b) { return Token::cmp(a, b); });
-	} else if (current_token.str == "lt") {
-		return binary_func([](Token a, Token b) { return Token::lt(a, b); });
-	} else if (current_token.str == "gt") {
-		return binary_func([](Token a, Token b) { return Token::gt(a, b); });
-	} else if (current_token.str == "and") {
-		return binary_func([](Token a, Token b) { return Token::and_op(a, b); });
-	} else if (current_token.str == "or") {
-		return binary_func([](Token a, Token b) { return Token::or_op(a, b); });
-	} else if (current_token.str == "xor") {
-		return binary_func([](Token a, Token b) { return Token::xor_op(a, b); });
-	} else if (current_token.str == "not") {
-		return unary_func([](Token a) { return Token::not_op(a); });
+	if (fuse_instructions && current_token.fused != Token::FUSED_NONE && try_execute_fused_instruction(current_token.fused)) {
+		return true;
+	} else if (jit && try_execute_jit()) {
+		return true;
+	} else if (eager_reduction && try_execute_eager_reduction()) {
+		return true;
+	} else if (const NativeFunction* function = get_native(current_token.get_data<InstructionDataType>())) {
+		return native_func(*function);
+	} else if (Token::UnaryFunc func = Token::get_unary_func(current_token.str)) {
+		return unary_func(func);
+	} else if (Token::BinaryFunc func = Token::get_binary_func(current_token.str)) {
+		return binary_func(func);
 	} else {
 		return try_execute_mod_instruction();
 	}
 }
 
+// Executes the whole pattern in one iteration, giving the same tokens
+// the unfused instructions would leave a few iterations later.
+// Falls back to normal execution if the pattern has changed since it was marked
+// or the get target is not a plain number.
+bool Interpreter::try_execute_fused_instruction(Token::FusedKind kind) {
+	if (Token::match_fused(prev_tokens, program_counter) != kind) {
+		return false;
+	}
+	auto get_value = [&](ProgramCounterType get_index) -> Token* {
+		PointerDataType src = prev_tokens[get_index + 1].get_data_cast<PointerDataType>();
+		ProgramCounterType src_index = token_index(prev_tokens, get_index + 1 + src);
+		if (src_index == prev_tokens.size() || !prev_tokens[src_index].is_num()) {
+			return nullptr;
+		}
+		return &prev_tokens[src_index];
+	};
+	if (kind == Token::FUSED_FUNC_GET) {
+		Token* value = get_value(program_counter + 1);
+		if (!value) {
+			return false;
+		}
+		Token::BinaryFunc func = Token::get_binary_func(prev_tokens[program_counter].str);
+		Token result = func(*value, prev_tokens[program_counter + 3]);
+		replace_tokens_func(program_counter, program_counter + 4, program_counter, { result });
+		program_counter += 3;
+		return true;
+	} else if (kind == Token::FUSED_SET_FUNC_GET) {
+		Token* value = get_value(program_counter + 3);
+		PointerDataType dst = prev_tokens[program_counter + 1].get_data_cast<PointerDataType>();
+		ProgramCounterType dst_index_begin = token_index(prev_tokens, program_counter + 1 + dst);
+		bool dst_inside = dst_index_begin >= program_counter && dst_index_begin < program_counter + 6;
+		if (!value || dst_inside || dst_index_begin == prev_tokens.size() || prev_tokens[dst_index_begin].str == "end") {
+			return false;
+		}
+		Token::BinaryFunc func = Token::get_binary_func(prev_tokens[program_counter + 2].str);
+		Token result = func(*value, prev_tokens[program_counter + 5]);
+		delete_tokens(program_counter, program_counter + 6, OP_PRIORITY_WEAK_DELETE);
+		Token* dst_node = &prev_tokens[dst_index_begin];
+		replace_tokens(dst_index_begin, dst_node->last_index + 1, program_counter + 2, store_tokens({ result }));
+		program_counter += 5;
+		return true;
+	} else if (kind == Token::FUSED_PRINT_STR_GET) {
+		Token* value = get_value(program_counter + 2);
+		if (!value) {
+			return false;
+		}
+		local_print_buffer += value->to_string();
+		delete_tokens(program_counter, program_counter + 4, OP_PRIORITY_WEAK_DELETE);
+		program_counter += 3;
+		return true;
+	}
+	return false;
+}
+
+// Reduces the subtree in one step if it consists only of
+// numbers and pure functions and has more than one level.
+bool Interpreter::try_execute_eager_reduction() {
+	ProgramCounterType last_index = prev_tokens[program_counter].last_index;
+	bool nested = false;
+	for (ProgramCounterType i = program_counter; i <= last_index; i++) {
+		Token& token = prev_tokens[i];
+		if (token.is_num()) {
+			continue;
+		}
+		if (token.is_ptr() || !Token::get_unary_func(token.str) && !Token::get_binary_func(token.str)) {
+			return false;
+		}
+		nested = nested || i > program_counter;
+	}
+	if (!nested) {
+		return false;
+	}
+	ProgramCounterType index = program_counter;
+	Token result = evaluate_pure_subtree(index);
+	replace_tokens_func(program_counter, last_index + 1, program_counter, { result });
+	program_counter = last_index;
+	return true;
+}
+
+// Reduces the subtree in one step with compiled code if it consists only of int32 numbers
+// and instructions the jit supports, has more than one level and its shape is hot.
+bool Interpreter::try_execute_jit() {
+	ProgramCounterType last_index = prev_tokens[program_counter].last_index;
+	jit_shape.clear();
+	jit_leaves.clear();
+	bool nested = false;
+	for (ProgramCounterType i = program_counter; i <= last_index; i++) {
+		Token& token = prev_tokens[i];
+		if (token.type == type_int32) {
+			jit_shape.push_back(jit::LEAF);
+			jit_leaves.push_back(token.get_data<Int32Type>());
+			continue;
+		}
+		if (token.type != type_instr || !jit::is_supported_instruction(token.get_data<InstructionDataType>())) {
+			return false;
+		}
+		jit_shape.push_back(token.get_data<InstructionDataType>());
+		nested = nested || i > program_counter;
+	}
+	if (!nested) {
+		return false;
+	}
+	jit::CompiledFunc func = jit_cache.get(jit_shape);
+	if (!func) {
+		return false;
+	}
+	Token result;
+	result.type = type_int32;
+	result.set_data<Int32Type>(func(jit_leaves.data()));
+	result.str = result.to_string();
+	if (jit_verify) {
+		ProgramCounterType index = program_counter;
+		Token expected = evaluate_pure_subtree(index);
+		if (expected.type != result.type || expected != result) {
+			throw std::runtime_error("Compiled code result " + result.to_string() + " does not match " + expected.to_string());
+		}
+	}
+	replace_tokens_func(program_counter, last_index + 1, program_counter, { result });
+	program_counter = last_index;
+	return true;
+}
+
+Token Interpreter::evaluate_pure_subtree(ProgramCounterType& index) {
+	Token& token = prev_tokens[index++];
+	if (token.is_num()) {
+		return token;
+	} else if (Token::UnaryFunc unary = Token::get_unary_func(token.str)) {
+		return unary(evaluate_pure_subtree(index));
+	} else {
+		Token::BinaryFunc binary = Token::get_binary_func(token.str);
+		Token first = evaluate_pure_subtree(index);
+		Token second = evaluate_pure_subtree(index);
+		return binary(first, second);
+	}
+}
+
 bool Interpreter::try_execute_mod_instruction() {
 	Token current_token = rel_token(prev_tokens, 0);
 	if (current_token.str == "cpy") {
@@ -231,9 +490,7 @@ bool Interpreter::try_execute_mod_instruction() {
 			ProgramCounterType dst_index = token_index(prev_tokens, program_counter + 2 + dst);
 			delete_tokens(program_counter, program_counter + 3, OP_PRIORITY_WEAK_DELETE);
 			if (src_index_begin != prev_tokens.size() && prev_tokens[src_index_begin].str != "end" && parent_is_container(dst_index, true)) {
-				Token* node = &prev_tokens[token_index(prev_tokens, src_index_begin)];
-				std::vector<Token> node_tokens = node->tokenize(prev_tokens);
-				insert_tokens(src_index_begin, dst_index, node_tokens);
+				insert_tokens(src_index_begin, dst_index, subtree_span(src_index_begin));
 			}
 			return true;
 		}
@@ -244,9 +501,7 @@ bool Interpreter::try_execute_mod_instruction() {
 			ProgramCounterType target_index = token_index(prev_tokens, program_counter + 1 + arg);
 			delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
 			if (target_index != prev_tokens.size() && prev_tokens[target_index].str != "end" && parent_is_container(target_index, true)) {
-				Token* node = &prev_tokens[token_index(prev_tokens, target_index)];
-				std::vector<Token> node_tokens = node->tokenize(prev_tokens);
-				delete_tokens(target_index, target_index + node_tokens.size(), OP_PRIORITY_STRONG_DELETE);
+				delete_tokens(target_index, prev_tokens[target_index].last_index + 1, OP_PRIORITY_STRONG_DELETE);
 			}
 			return true;
 		}
@@ -256,9 +511,7 @@ bool Interpreter::try_execute_mod_instruction() {
 			PointerDataType src = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
 			PointerDataType src_index_begin = token_index(prev_tokens, program_counter + 1 + src);
 			if (src_index_begin != prev_tokens.size() && prev_tokens[src_index_begin].str != "end") {
-				Token* src_node = &prev_tokens[token_index(prev_tokens, src_index_begin)];
-				std::vector<Token> src_node_tokens = src_node->tokenize(prev_tokens);
-				replace_tokens(program_counter, program_counter + 2, src_index_begin, src_node_tokens);
+				replace_tokens(program_counter, program_counter + 2, src_index_begin, subtree_span(src_index_begin));
 			} else {
 				delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
 			}
@@ -274,12 +527,10 @@ bool Interpreter::try_execute_mod_instruction() {
 			if (dst_index_begin != prev_tokens.size() && prev_tokens[dst_index_begin].str != "end") {
 				Token* src_node = &prev_tokens[token_index(prev_tokens, src_index_begin)];
 				if (prev_tokens[src_node->first_index].str == "q") {
-					src_node = &prev_tokens[src_node->arguments[0]];
+					src_node = &prev_tokens[child_at(src_node->first_index, 0)];
 				}
 				Token* dst_node = &prev_tokens[token_index(prev_tokens, dst_index_begin)];
-				std::vector<Token> src_node_tokens = src_node->tokenize(prev_tokens);
-				std::vector<Token> dst_node_tokens = dst_node->tokenize(prev_tokens);
-				replace_tokens(dst_index_begin, dst_node->last_index + 1, src_index_begin, src_node_tokens);
+				replace_tokens(dst_index_begin, dst_node->last_index + 1, src_index_begin, subtree_span(src_node->first_index));
 			}
 			return true;
 		}
@@ -293,10 +544,9 @@ bool Interpreter::try_execute_mod_instruction() {
 			if (parent_is_container(dst_index_begin, true)) {
 				Token* src_node = &prev_tokens[token_index(prev_tokens, src_index_begin)];
 				if (prev_tokens[src_node->first_index].str == "q") {
-					src_node = &prev_tokens[src_node->arguments[0]];
+					src_node = &prev_tokens[child_at(src_node->first_index, 0)];
 				}
-				std::vector<Token> src_node_tokens = src_node->tokenize(prev_tokens);
-				insert_tokens(src_index_begin, dst_index_begin, src_node_tokens);
+				insert_tokens(src_index_begin, dst_index_begin, subtree_span(src_node->first_index));
 			}
 			return true;
 		}
@@ -313,10 +563,8 @@ bool Interpreter::try_execute_mod_instruction() {
 				&& prev_tokens[src_index_begin].str != "end" && prev_tokens[dst_index_begin].str != "end"
 			) {
 				Token* dst_node = &prev_tokens[token_index(prev_tokens, dst_index_begin)];
-				Token* src_node = &prev_tokens[token_index(prev_tokens, src_index_begin)];
 				ProgramCounterType dst_index_end = dst_node->last_index + 1;
-				std::vector<Token> src_node_tokens = src_node->tokenize(prev_tokens);
-				replace_tokens(dst_index_begin, dst_index_end, src_index_begin, src_node_tokens);
+				replace_tokens(dst_index_begin, dst_index_end, src_index_begin, subtree_span(src_index_begin));
 			}
 			return true;
 		}
@@ -373,11 +621,11 @@ bool Interpreter::try_execute_mod_instruction() {
 		if (rel_token(prev_tokens, 1).is_num_or_ptr()) {
 			BoolType cond = rel_token(prev_tokens, 1).get_data_cast<BoolType>();
 			Token* if_node = &prev_tokens[token_index(prev_tokens, program_counter)];
-			Token* true_node = &prev_tokens[if_node->arguments[1]];
-			Token* false_node = &prev_tokens[if_node->arguments[2]];
+			Token* true_node = &prev_tokens[child_at(if_node->first_index, 1)];
+			Token* false_node = &prev_tokens[child_at(if_node->first_index, 2)];
 			Token* selected_node = cond != 0 ? true_node : false_node;
 			if (prev_tokens[selected_node->first_index].str == "q") {
-				selected_node = &prev_tokens[selected_node->arguments[0]];
+				selected_node = &prev_tokens[child_at(selected_node->first_index, 0)];
 			}
 			movereplace_tokens(
 				selected_node->first_index, selected_node->last_index + 1,
@@ -388,8 +636,8 @@ bool Interpreter::try_execute_mod_instruction() {
 		return false;
 	} else if (current_token.str == "cast") {
 		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num_or_ptr()) {
-			Token& arg1 = rel_token(prev_tokens, 1);
-			Token& arg2 = rel_token(prev_tokens, 2);
+			Token arg1 = rel_token(prev_tokens, 1);
+			Token arg2 = rel_token(prev_tokens, 2);
 			if (arg1.is_ptr()) {
 				arg1.set_data<PointerDataType>(arg1.get_data<PointerDataType>() + 1);
 			}
@@ -397,7 +645,7 @@ bool Interpreter::try_execute_mod_instruction() {
 				arg2.set_data<PointerDataType>(arg2.get_data<PointerDataType>() + 2);
 			}
 			token_type type = static_cast<token_type>(arg1.get_data_cast<Int32Type>());
-			if (type >= 0 && type < type_unknown && type != type_instr) {
+			if (type >= 0 && type < type_unknown && type != type_instr && type != type_object) {
 				arg2.cast(type);
 				if (type == type_ptr) {
 					arg2.set_data<PointerDataType>(arg2.get_data<PointerDataType>() + 2);
@@ -439,20 +687,299 @@ bool Interpreter::try_execute_mod_instruction() {
 	} else if (current_token.str == "str") {
 		if (rel_token(prev_tokens, 1).is_num_or_ptr()) {
 			Token& arg = rel_token(prev_tokens, 1);
-			std::string str = arg.to_string();
+			replace_tokens_func(program_counter, program_counter + 2, program_counter, chars_to_list(arg.to_string()));
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "read") {
+		if (rel_token(prev_tokens, 1).is_num()) {
+			Int64Type count = rel_token(prev_tokens, 1).get_data_cast<Int64Type>();
+			std::string str;
+			if (!input.read(std::max<Int64Type>(count, 0), str)) {
+				waiting_for_input = true;
+				return false;
+			}
+			replace_tokens_func(program_counter, program_counter + 2, program_counter, chars_to_list(str));
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "readline") {
+		std::string str;
+		if (!input.read_line(str)) {
+			waiting_for_input = true;
+			return false;
+		}
+		replace_tokens_func(program_counter, program_counter + 1, program_counter, chars_to_list(str));
+		return true;
+	} else if (current_token.str == "eof") {
+		bool is_end;
+		if (!input.at_end(is_end)) {
+			waiting_for_input = true;
+			return false;
+		}
+		Token result;
+		result.type = type_int32;
+		result.set_data<Int32Type>(is_end ? 1 : 0);
+		result.str = result.to_string();
+		replace_tokens_func(program_counter, program_counter + 1, program_counter, { result });
+		return true;
+	} else if (current_token.str == "pack") {
+		Token& list_token = rel_token(prev_tokens, 1);
+		if (list_token.str == "list") {
+			ProgramCounterType list_index = token_index(prev_tokens, program_counter + 1);
+			token_type elem_type = type_int32;
+			for (ProgramCounterType elem_i = list_index + 1; elem_i < list_token.last_index; elem_i++) {
+				if (!prev_tokens[elem_i].is_num()) {
+					return false;
+				}
+				token_type current_type = prev_tokens[elem_i].type;
+				elem_type = elem_i == list_index + 1 ? current_type : Token::get_return_type(elem_type, current_type);
+			}
+			std::shared_ptr<PackedArray> array = std::make_shared<PackedArray>(elem_type);
+			for (ProgramCounterType elem_i = list_index + 1; elem_i < list_token.last_index; elem_i++) {
+				array->insert(array->size(), prev_tokens[elem_i]);
+			}
+			replace_tokens_func(program_counter, list_token.last_index + 1, program_counter, { Token(array) });
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "freeze") {
+		ProgramCounterType tree_index = token_index(prev_tokens, program_counter + 1);
+		if (tree_index == prev_tokens.size() || prev_tokens[tree_index].node_flags & NODE_END) {
+			return false;
+		}
+		ProgramCounterType tree_end = prev_tokens[tree_index].last_index + 1;
+		for (ProgramCounterType token_i = tree_index; token_i < tree_end; token_i++) {
+			if (!SharedTree::is_tree_token(prev_tokens[token_i])) {
+				return false;
+			}
+		}
+		std::shared_ptr<SharedTree> tree = std::make_shared<SharedTree>(
+			std::vector<Token>(prev_tokens.begin() + tree_index, prev_tokens.begin() + tree_end)
+		);
+		replace_tokens_func(program_counter, tree_end, program_counter, { Token(tree) });
+		return true;
+	} else if (current_token.str == "unpack") {
+		if (rel_token(prev_tokens, 1).is_object()) {
+			PackedArray* array = get_array(token_index(prev_tokens, program_counter + 1));
+			FileView* file_view = get_file_view(token_index(prev_tokens, program_counter + 1));
+			SharedTree* tree = dynamic_cast<SharedTree*>(rel_token(prev_tokens, 1).object.get());
+			if (tree) {
+				replace_tokens_func(program_counter, program_counter + 2, program_counter, tree->get_tokens());
+				return true;
+			}
+			if (!array && !file_view) {
+				return false;
+			}
 			std::vector<Token> results;
 			results.push_back(Token("list"));
-			for (ProgramCounterType char_i = 0; char_i < str.size(); char_i++) {
-				Token char_token;
-				char_token.type = type_int32;
-				char_token.set_data<Int32Type>(str[char_i]);
-				results.push_back(char_token);
+			ProgramCounterType size = array ? array->size() : file_view->size();
+			for (ProgramCounterType elem_i = 0; elem_i < size; elem_i++) {
+				results.push_back(array ? array->get(elem_i) : file_view->get(elem_i));
 			}
 			results.push_back(Token("end"));
 			replace_tokens_func(program_counter, program_counter + 2, program_counter, results);
 			return true;
 		}
 		return false;
+	} else if (current_token.str == "alen") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			PackedArray* array = get_array(token_index(prev_tokens, program_counter + 1 + arg));
+			FileView* file_view = get_file_view(token_index(prev_tokens, program_counter + 1 + arg));
+			if (array || file_view) {
+				Token result;
+				result.type = type_int64;
+				result.set_data<Int64Type>(array ? array->size() : file_view->size());
+				result.str = result.to_string();
+				replace_tokens_func(program_counter, program_counter + 2, program_counter, { result });
+			} else {
+				delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "aget") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			PointerDataType elem_index = rel_token(prev_tokens, 2).get_data_cast<PointerDataType>();
+			PackedArray* array = get_array(token_index(prev_tokens, program_counter + 1 + arg));
+			FileView* file_view = get_file_view(token_index(prev_tokens, program_counter + 1 + arg));
+			if (array && elem_index >= 0 && elem_index < array->size()) {
+				replace_tokens_func(program_counter, program_counter + 3, program_counter, { array->get(elem_index) });
+			} else if (file_view && elem_index >= 0 && elem_index < file_view->size()) {
+				replace_tokens_func(program_counter, program_counter + 3, program_counter, { file_view->get(elem_index) });
+			} else {
+				delete_tokens(program_counter, program_counter + 3, OP_PRIORITY_WEAK_DELETE);
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "aset" || current_token.str == "ains") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num() && rel_token(prev_tokens, 3).is_num()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			PointerDataType elem_index = rel_token(prev_tokens, 2).get_data_cast<PointerDataType>();
+			Token value = rel_token(prev_tokens, 3);
+			ProgramCounterType array_index = token_index(prev_tokens, program_counter + 1 + arg);
+			PackedArray* array = get_array(array_index);
+			delete_tokens(program_counter, program_counter + 4, OP_PRIORITY_WEAK_DELETE);
+			bool insert = current_token.str == "ains";
+			PointerDataType max_index = array ? array->size() - (insert ? 0 : 1) : -1;
+			if (array && elem_index >= 0 && elem_index <= max_index) {
+				write_object(array_index, [=](TokenObject& object) {
+					PackedArray& target = static_cast<PackedArray&>(object);
+					if (insert && elem_index <= target.size()) {
+						target.insert(elem_index, value);
+					} else if (!insert && elem_index < target.size()) {
+						target.set(elem_index, value);
+					}
+				});
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "adel") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			PointerDataType elem_index = rel_token(prev_tokens, 2).get_data_cast<PointerDataType>();
+			ProgramCounterType array_index = token_index(prev_tokens, program_counter + 1 + arg);
+			PackedArray* array = get_array(array_index);
+			delete_tokens(program_counter, program_counter + 3, OP_PRIORITY_WEAK_DELETE);
+			if (array && elem_index >= 0 && elem_index < array->size()) {
+				write_object(array_index, [=](TokenObject& object) {
+					PackedArray& target = static_cast<PackedArray&>(object);
+					if (elem_index < target.size()) {
+						target.erase(elem_index);
+					}
+				});
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "file") {
+		std::vector<Token> path_chars;
+		if (get_list_elements(token_index(prev_tokens, program_counter + 1), path_chars)) {
+			std::string path;
+			for (Token& char_token : path_chars) {
+				path += (char)char_token.get_data_cast<Int32Type>();
+			}
+			Token& list_token = rel_token(prev_tokens, 1);
+			replace_tokens_func(program_counter, list_token.last_index + 1, program_counter, { Token(FileView::open(path)) });
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "chunk") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num() && rel_token(prev_tokens, 3).is_num()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			Int64Type offset = rel_token(prev_tokens, 2).get_data_cast<Int64Type>();
+			Int64Type size = rel_token(prev_tokens, 3).get_data_cast<Int64Type>();
+			FileView* file_view = get_file_view(token_index(prev_tokens, program_counter + 1 + arg));
+			if (file_view && offset >= 0 && size >= 0) {
+				replace_tokens_func(program_counter, program_counter + 4, program_counter, { Token(file_view->chunk(offset, size)) });
+			} else {
+				delete_tokens(program_counter, program_counter + 4, OP_PRIORITY_WEAK_DELETE);
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "param") {
+		throw std::runtime_error("Unbound parameter: " + current_token.orig_str);
+	} else if (current_token.str == "map") {
+		replace_tokens_func(program_counter, program_counter + 1, program_counter, { Token(std::make_shared<HashMap>()) });
+		return true;
+	} else if (current_token.str == "mput") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num() && rel_token(prev_tokens, 3).is_num()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			Token key = rel_token(prev_tokens, 2);
+			Token value = rel_token(prev_tokens, 3);
+			ProgramCounterType map_index = token_index(prev_tokens, program_counter + 1 + arg);
+			delete_tokens(program_counter, program_counter + 4, OP_PRIORITY_WEAK_DELETE);
+			if (get_map(map_index)) {
+				write_object(map_index, [=](TokenObject& object) {
+					static_cast<HashMap&>(object).put(key, value);
+				});
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "mget" || current_token.str == "mhas" || current_token.str == "mdel") {
+		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num()) {
+			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+			Token key = rel_token(prev_tokens, 2);
+			ProgramCounterType map_index = token_index(prev_tokens, program_counter + 1 + arg);
+			HashMap* map = get_map(map_index);
+			const Token* value = map ? map->get(key) : nullptr;
+			if (current_token.str == "mhas" && map) {
+				Token result;
+				result.type = type_int32;
+				result.set_data<Int32Type>(value ? 1 : 0);
+				result.str = result.to_string();
+				replace_tokens_func(program_counter, program_counter + 3, program_counter, { result });
+			} else if (current_token.str == "mget" && value) {
+				replace_tokens_func(program_counter, program_counter + 3, program_counter, { *value });
+			} else {
+				delete_tokens(program_counter, program_counter + 3, OP_PRIORITY_WEAK_DELETE);
+				if (current_token.str == "mdel" && value) {
+					write_object(map_index, [=](TokenObject& object) {
+						static_cast<HashMap&>(object).erase(key);
+					});
+				}
+			}
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "malloc") {
+		if (rel_token(prev_tokens, 1).is_num()) {
+			Int64Type size = rel_token(prev_tokens, 1).get_data_cast<Int64Type>();
+			if (size < 0) {
+				throw std::runtime_error("Negative malloc size: " + std::to_string(size));
+			}
+			Token result;
+			result.type = type_int64;
+			result.set_data<Int64Type>(heap.malloc(size));
+			result.str = result.to_string();
+			hash_external_write();
+			replace_tokens_func(program_counter, program_counter + 2, program_counter, { result });
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "free") {
+		if (rel_token(prev_tokens, 1).is_num()) {
+			heap.free(rel_token(prev_tokens, 1).get_data_cast<Int64Type>());
+			hash_external_write();
+			delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "load") {
+		if (rel_token(prev_tokens, 1).is_num() && rel_token(prev_tokens, 2).is_num()) {
+			token_type type = static_cast<token_type>(rel_token(prev_tokens, 1).get_data_cast<Int32Type>());
+			Int64Type address = rel_token(prev_tokens, 2).get_data_cast<Int64Type>();
+			replace_tokens_func(program_counter, program_counter + 3, program_counter, { heap.load(address, type) });
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "store") {
+		if (rel_token(prev_tokens, 1).is_num() && rel_token(prev_tokens, 2).is_num()) {
+			heap.store(rel_token(prev_tokens, 1).get_data_cast<Int64Type>(), rel_token(prev_tokens, 2));
+			hash_external_write();
+			delete_tokens(program_counter, program_counter + 3, OP_PRIORITY_WEAK_DELETE);
+			return true;
+		}
+		return false;
+	} else if (current_token.str == "sum" || current_token.str == "min" || current_token.str == "max" || current_token.str == "dot") {
+		return reduce_func(current_token.str);
+	} else if (
+		current_token.str == "len" || current_token.str == "getsize" || current_token.str == "find"
+		|| current_token.str == "slice" || current_token.str == "concat"
+		|| current_token.str == "reverse" || current_token.str == "sort"
+	) {
+		return list_func(current_token.str);
+	} else if (
+		current_token.str == "next" || current_token.str == "prev"
+		|| current_token.str == "up" || current_token.str == "down" || current_token.str == "getaddr"
+	) {
+		return nav_func(current_token.str);
 	} else if (current_token.str == "box") {
 		if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num_or_ptr()) {
 			PointerDataType begin = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
@@ -466,8 +993,8 @@ bool Interpreter::try_execute_mod_instruction() {
 			bool cont_args = same_parent && parent_is_container(begin_index_new, true);
 			bool one_arg = prev_tokens[begin_index_new].last_index == end_index_new - 1;
 			if (cont_args || one_arg) {
-				insert_tokens(0, begin_index_new, { Token("list") });
-				insert_tokens(0, end_index_new, { Token("end") });
+				insert_tokens(0, begin_index_new, store_tokens({ Token("list") }));
+				insert_tokens(0, end_index_new, store_tokens({ Token("end") }));
 			}
 			return true;
 		}
@@ -477,7 +1004,7 @@ bool Interpreter::try_execute_mod_instruction() {
 			PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
 			ProgramCounterType header_index = token_index(prev_tokens, program_counter + 1 + arg);
 			delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
-			bool one_arg = prev_tokens[header_index].arguments.size() == 2;
+			bool one_arg = child_count(header_index) == 2;
 			if (prev_tokens[header_index].is_container_header() && (parent_is_container(header_index, true) || one_arg)) {
 				ProgramCounterType end_index = prev_tokens[header_index].last_index;
 				delete_tokens(header_index, header_index + 1, OP_PRIORITY_STRONG_DELETE);
@@ -496,7 +1023,7 @@ bool Interpreter::try_execute_mod_instruction() {
 		return true;
 	} else if (current_token.str == "end") {
 		PointerDataType header_index = prev_tokens[program_counter].parent_index;
-		auto one_arg = [&]() { return prev_tokens[header_index].arguments.size() == 2; };
+		auto one_arg = [&]() { return child_count(header_index) == 2; };
 		if (
 			parent_is_ulist_or_useq()
 			&& !scope_list.back().instruction_executed
@@ -518,22 +1045,28 @@ bool Interpreter::try_execute_mod_instruction() {
 void Interpreter::parse(ProgramCounterType index, bool one) {
 	try {
 		std::stack<PointerDataType> parent_stack;
+		// child_offsets[i] counts the children of i first and becomes their end offset after the prefix sum,
+		// filling child_indices backwards then leaves it at their begin offset
+		child_offsets.assign(tokens.size() + 1, 0);
 		for (PointerDataType token_i = index; token_i < tokens.size(); token_i++) {
 			Token& current_token = tokens[token_i];
-			if (current_token.str == "end" && parent_stack.empty()) {
+			if ((current_token.node_flags & NODE_END) && parent_stack.empty()) {
 				throw std::runtime_error("Mismathed end");
 			}
 			current_token.parent_index = -1;
+			current_token.parent_flags = 0;
 			current_token.arg_count = 0;
-			current_token.arguments.clear(); // might reinitialize instead for saving memory
 			current_token.first_index = token_i;
 			current_token.last_index = 0;
+			current_token.subtree_changed = current_token.changed;
+			current_token.changed = false;
 			if (!parent_stack.empty()) {
 				current_token.parent_index = parent_stack.top();
-				tokens[parent_stack.top()].arguments.push_back(token_i);
+				current_token.parent_flags = tokens[parent_stack.top()].node_flags;
+				child_offsets[parent_stack.top()]++;
 			}
 			ProgramCounterType arg_count = 0;
-			if (!current_token.is_num_or_ptr()) {
+			if (!current_token.is_value()) {
 				arg_count = get_arg_count(current_token.get_data_cast<InstructionDataType>());
 			}
 			current_token.arg_count = arg_count;
@@ -546,10 +1079,10 @@ void Interpreter::parse(ProgramCounterType index, bool one) {
 			ProgramCounterType current_last_index;
 			bool first = true;
 			while (!parent_stack.empty()) {
+				// current_index is the last child added to the parent and its subtree is complete
 				Token& current_parent = tokens[parent_stack.top()];
-				ProgramCounterType arg_offset = current_index - current_parent.first_index;
-				bool arg_offset_end = arg_offset >= current_parent.arg_count;
-				bool end_end = tokens[current_index].str == "end";
+				bool arg_offset_end = child_offsets[parent_stack.top()] >= current_parent.arg_count;
+				bool end_end = tokens[current_index].node_flags & NODE_END;
 				auto exit_level = [&]() {
 					if (first) {
 						current_last_index = current_index;
@@ -572,12 +1105,42 @@ void Interpreter::parse(ProgramCounterType index, bool one) {
 		if (!parent_stack.empty()) {
 			throw std::runtime_error("Missing end");
 		}
+		for (ProgramCounterType token_i = 0; token_i < tokens.size(); token_i++) {
+			child_offsets[token_i + 1] += child_offsets[token_i];
+		}
+		child_indices.resize(child_offsets[tokens.size()]);
+		ProgramCounterType next_instruction_index = tokens.size();
+		for (PointerDataType token_i = (PointerDataType)tokens.size() - 1; token_i >= (PointerDataType)index; token_i--) {
+			Token& current_token = tokens[token_i];
+			if (current_token.has_parent()) {
+				child_indices[--child_offsets[current_token.parent_index]] = token_i;
+			}
+			if (!current_token.is_value()) {
+				next_instruction_index = token_i;
+			}
+			current_token.next_instruction_index = next_instruction_index;
+			if (current_token.subtree_changed && current_token.has_parent()) {
+				tokens[current_token.parent_index].subtree_changed = true;
+			}
+		}
 	} catch (std::exception exc) {
 		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
 	}
 }
 
+ProgramCounterType Interpreter::child_count(ProgramCounterType index) {
+	return child_offsets[index + 1] - child_offsets[index];
+}
+
+PointerDataType Interpreter::child_at(ProgramCounterType index, ProgramCounterType arg_i) {
+	return child_indices[child_offsets[index] + arg_i];
+}
+
 PointerDataType Interpreter::token_index(std::vector<Token>& token_list, PointerDataType index) {
+	// almost every address is already in range, a single unsigned compare covers negative values too
+	if ((Uint64Type)index <= (Uint64Type)token_list.size()) {
+		return index;
+	}
 	return utils::mod(index, (PointerDataType)token_list.size() + 1);
 }
 
@@ -592,14 +1155,14 @@ Token& Interpreter::rel_token(std::vector<Token>& token_list, PointerDataType of
 bool Interpreter::inside_seq() {
 	return
 		scope_list.size() > 0
-		&& get_token(prev_tokens, scope_list.back().pos).str == "seq"
+		&& (get_token(prev_tokens, scope_list.back().pos).node_flags & (NODE_SEQ | NODE_ORDERED)) == (NODE_SEQ | NODE_ORDERED)
 	;
 }
 
 bool Interpreter::inside_list() {
 	return
 		scope_list.size() > 0
-		&& get_token(prev_tokens, scope_list.back().pos).str == "list"
+		&& (get_token(prev_tokens, scope_list.back().pos).node_flags & (NODE_CONTAINER | NODE_ORDERED | NODE_SEQ)) == (NODE_CONTAINER | NODE_ORDERED)
 	;
 }
 
@@ -608,26 +1171,19 @@ bool Interpreter::inside_container() {
 }
 
 bool Interpreter::parent_is_seq_or_useq() {
-	PointerDataType parent_index = prev_tokens[program_counter].parent_index;
-	return parent_index >= 0
-		&& (prev_tokens[parent_index].str == "seq" || prev_tokens[parent_index].str == "useq");
+	return prev_tokens[program_counter].parent_flags & NODE_SEQ;
 }
 
 bool Interpreter::parent_is_list_or_ulist() {
-	PointerDataType parent_index = prev_tokens[program_counter].parent_index;
-	return parent_index >= 0
-		&& (prev_tokens[parent_index].str == "list" || prev_tokens[parent_index].str == "ulist");
+	return (prev_tokens[program_counter].parent_flags & (NODE_CONTAINER | NODE_SEQ)) == NODE_CONTAINER;
 }
 
 bool Interpreter::parent_is_ulist_or_useq() {
-	PointerDataType parent_index = prev_tokens[program_counter].parent_index;
-	return parent_index >= 0
-		&& (prev_tokens[parent_index].str == "ulist" || prev_tokens[parent_index].str == "useq");
+	return (prev_tokens[program_counter].parent_flags & (NODE_CONTAINER | NODE_ORDERED)) == NODE_CONTAINER;
 }
 
 bool Interpreter::parent_is_if() {
-	PointerDataType parent_index = prev_tokens[program_counter].parent_index;
-	return parent_index >= 0 && prev_tokens[parent_index].str == "if";
+	return prev_tokens[program_counter].parent_flags & NODE_IF;
 }
 
 bool Interpreter::IndexShiftEntry::is_deleted() {
@@ -692,7 +1248,17 @@ PointerDataType Interpreter::to_src_index(PointerDataType new_index) {
 	return index_shift_rev[new_index];
 }
 
-void Interpreter::insert_op_exec(PointerDataType old_src_pos, ProgramCounterType old_dst_pos, std::vector<Token> insert_tokens, OpType op_type) {
+Interpreter::TokenSpan Interpreter::subtree_span(ProgramCounterType index) {
+	return TokenSpan(&prev_tokens, index, prev_tokens[index].last_index + 1);
+}
+
+Interpreter::TokenSpan Interpreter::store_tokens(std::vector<Token> new_tokens) {
+	ProgramCounterType begin = op_tokens.size();
+	op_tokens.insert(op_tokens.end(), new_tokens.begin(), new_tokens.end());
+	return TokenSpan(&op_tokens, begin, op_tokens.size());
+}
+
+void Interpreter::insert_op_exec(PointerDataType old_src_pos, ProgramCounterType old_dst_pos, const TokenSpan& insert_tokens, OpType op_type, bool local_pointers) {
 	PointerDataType offset = insert_tokens.size();
 	PointerDataType new_dst_pos = -1;
 	for (ProgramCounterType i = old_dst_pos; i < index_shift.size(); i++) {
@@ -726,7 +1292,7 @@ void Interpreter::insert_op_exec(PointerDataType old_src_pos, ProgramCounterType
 	for (ProgramCounterType i = 0; i < offset; i++) {
 		PointerDataType current_pos = old_src_pos + i;
 		Token& current_token = insert_tokens[i];
-		if (current_token.is_ptr()) {
+		if (current_token.is_ptr() && !local_pointers) {
 			PointerDataType pointer = current_token.get_data_cast<PointerDataType>();
 			PointerDataType old_dst = token_index(prev_tokens, current_pos + pointer);
 			if (old_dst >= old_src_pos && old_dst < old_src_pos + offset) {
@@ -739,7 +1305,8 @@ void Interpreter::insert_op_exec(PointerDataType old_src_pos, ProgramCounterType
 		}
 	}
 	index_shift_rev.insert(index_shift_rev.begin() + new_dst_pos, ins_vector.begin(), ins_vector.end());
-	tokens.insert(tokens.begin() + new_dst_pos, insert_tokens.begin(), insert_tokens.end());
+	bool is_copy = op_type == OP_TYPE_NORMAL || op_type == OP_TYPE_REPLACE;
+	insert_token_range(new_dst_pos, insert_tokens, is_copy && insert_tokens.source == &prev_tokens);
 }
 
 PointerDataType Interpreter::delete_op_exec(ProgramCounterType old_pos_begin, ProgramCounterType old_pos_end, OpType op_type) {
@@ -762,14 +1329,14 @@ PointerDataType Interpreter::delete_op_exec(ProgramCounterType old_pos_begin, Pr
 	}
 	PointerDataType new_pos_end = new_pos_begin + offset;
 	index_shift_rev.erase(index_shift_rev.begin() + new_pos_begin, index_shift_rev.begin() + new_pos_end);
-	tokens.erase(tokens.begin() + new_pos_begin, tokens.begin() + new_pos_end);
+	erase_token_range(new_pos_begin, new_pos_end);
 	return offset;
 }
 
 bool Interpreter::parent_is_container(ProgramCounterType index, bool root_is_container) {
 	auto end = [&]() { return index == prev_tokens.size(); };
 	auto hasparent = [&]() { return prev_tokens[index].has_parent(); };
-	auto parent_is_cont = [&]() { return prev_tokens[index].has_parent() && prev_tokens[index].get_parent(prev_tokens).is_container_header(); };
+	auto parent_is_cont = [&]() { return prev_tokens[index].parent_flags & NODE_CONTAINER; };
 	bool result;
 	if (root_is_container) {
 		result = end() || !hasparent() || parent_is_cont();
@@ -805,13 +1372,13 @@ void Interpreter::delete_tokens(ProgramCounterType pos_begin, ProgramCounterType
 	delete_ops.push_back(DeleteOp(pos_begin, pos_end, priority));
 }
 
-void Interpreter::insert_tokens(ProgramCounterType old_pos, ProgramCounterType new_pos, std::vector<Token> insert_tokens) {
+void Interpreter::insert_tokens(ProgramCounterType old_pos, ProgramCounterType new_pos, TokenSpan insert_tokens) {
 	insert_ops.push_back(InsertOp(old_pos, new_pos, insert_tokens));
 }
 
 void Interpreter::replace_tokens(
 	ProgramCounterType dst_begin, ProgramCounterType dst_end,
-	ProgramCounterType src_begin, std::vector<Token> src_tokens
+	ProgramCounterType src_begin, TokenSpan src_tokens
 ) {
 	replace_ops.push_back(ReplaceOp(dst_begin, dst_end, src_begin, src_tokens));
 }
@@ -820,13 +1387,51 @@ void Interpreter::replace_tokens_func(
 	ProgramCounterType dst_begin, ProgramCounterType dst_end,
 	ProgramCounterType src_begin, std::vector<Token> src_tokens
 ) {
-	func_replace_ops.push_back(ReplaceOp(dst_begin, dst_end, src_begin, src_tokens));
+	func_replace_ops.push_back(ReplaceOp(dst_begin, dst_end, src_begin, store_tokens(src_tokens)));
 }
 
 void Interpreter::move_tokens(ProgramCounterType old_begin, ProgramCounterType old_end, ProgramCounterType new_begin) {
 	move_ops.push_back(MoveOp(old_begin, old_end, new_begin));
 }
 
+void Interpreter::write_object(ProgramCounterType index, std::function<void(TokenObject&)> write) {
+	object_ops.push_back(ObjectOp(prev_tokens[index].object, write));
+}
+
+PackedArray* Interpreter::get_array(ProgramCounterType index) {
+	if (index == prev_tokens.size() || !prev_tokens[index].is_object()) {
+		return nullptr;
+	}
+	return dynamic_cast<PackedArray*>(prev_tokens[index].object.get());
+}
+
+HashMap* Interpreter::get_map(ProgramCounterType index) {
+	if (index == prev_tokens.size() || !prev_tokens[index].is_object()) {
+		return nullptr;
+	}
+	return dynamic_cast<HashMap*>(prev_tokens[index].object.get());
+}
+
+std::vector<Token> Interpreter::chars_to_list(std::string str) {
+	std::vector<Token> results;
+	results.push_back(Token("list"));
+	for (ProgramCounterType char_i = 0; char_i < str.size(); char_i++) {
+		Token char_token;
+		char_token.type = type_int32;
+		char_token.set_data<Int32Type>(str[char_i]);
+		results.push_back(char_token);
+	}
+	results.push_back(Token("end"));
+	return results;
+}
+
+FileView* Interpreter::get_file_view(ProgramCounterType index) {
+	if (index == prev_tokens.size() || !prev_tokens[index].is_object()) {
+		return nullptr;
+	}
+	return dynamic_cast<FileView*>(prev_tokens[index].object.get());
+}
+
 void Interpreter::movereplace_tokens(
 	ProgramCounterType old_begin, ProgramCounterType old_end,
 	ProgramCounterType new_begin, ProgramCounterType new_end
@@ -834,25 +1439,181 @@ void Interpreter::movereplace_tokens(
 	movereplace_ops.push_back(MoveReplaceOp(old_begin, old_end, new_begin, new_end));
 }
 
-void Interpreter::exec_replace_ops(std::vector<ReplaceOp>& vec, OpPriority priority) {
+utils::LongNumberType Interpreter::element_hash(PointerDataType index) {
+	if (index < 0 || index >= (PointerDataType)tokens.size()) {
+		return 0;
+	}
+	return tokens[index].hash();
+}
+
+utils::LongNumberType Interpreter::pair_hash(utils::LongNumberType left, utils::LongNumberType right) {
+	return utils::hash_combine(left, right + 1);
+}
+
+// State hash is the wrapping sum of hashes of all adjacent token pairs (with
+// boundary sentinels), so an op only has to update the pairs around the range it touches.
+void Interpreter::reset_state_hash() {
+	state_hash = 0;
+	state_hash_history.clear();
+	candidate_period = 0;
+	candidate_tokens.clear();
+	if (!detect_cycles) {
+		return;
+	}
+	for (PointerDataType i = 0; i <= (PointerDataType)tokens.size(); i++) {
+		state_hash += pair_hash(element_hash(i - 1), element_hash(i));
+	}
+}
+
+void Interpreter::erase_token_range(ProgramCounterType pos_begin, ProgramCounterType pos_end) {
+	if (detect_cycles) {
+		for (PointerDataType i = pos_begin; i <= (PointerDataType)pos_end; i++) {
+			state_hash -= pair_hash(element_hash(i - 1), element_hash(i));
+		}
+		state_hash += pair_hash(element_hash((PointerDataType)pos_begin - 1), element_hash(pos_end));
+	}
+	tokens.erase(tokens.begin() + pos_begin, tokens.begin() + pos_end);
+	if (pos_begin > 0) {
+		tokens[pos_begin - 1].changed = true;
+	}
+	if (pos_begin < tokens.size()) {
+		tokens[pos_begin].changed = true;
+	}
+	update_fused_marks(pos_begin, pos_begin);
+}
+
+void Interpreter::insert_token_range(ProgramCounterType pos, const TokenSpan& insert_tokens, bool clone_objects) {
+	ProgramCounterType pos_end = pos + insert_tokens.size();
+	utils::LongNumberType left = 0;
+	utils::LongNumberType right = 0;
+	if (detect_cycles) {
+		left = element_hash((PointerDataType)pos - 1);
+		right = element_hash(pos);
+	}
+	tokens.insert(tokens.begin() + pos, insert_tokens.tokens_begin(), insert_tokens.tokens_end());
+	for (ProgramCounterType i = pos; i < pos_end; i++) {
+		tokens[i].changed = true;
+	}
+	if (clone_objects) {
+		for (ProgramCounterType i = pos; i < pos_end; i++) {
+			if (tokens[i].is_object()) {
+				tokens[i].object = tokens[i].object->clone();
+			}
+		}
+	}
+	if (detect_cycles && insert_tokens.size() > 0) {
+		state_hash -= pair_hash(left, right);
+		for (ProgramCounterType i = pos; i < pos_end; i++) {
+			utils::LongNumberType current = tokens[i].hash();
+			state_hash += pair_hash(left, current);
+			left = current;
+		}
+		state_hash += pair_hash(left, right);
+	}
+	update_fused_marks(pos, pos_end);
+}
+
+void Interpreter::set_pointer_value(ProgramCounterType index, PointerDataType pointer) {
+	Token& token = tokens[index];
+	token.changed = token.changed || token.get_data<PointerDataType>() != pointer;
+	if (detect_cycles) {
+		utils::LongNumberType left = element_hash((PointerDataType)index - 1);
+		utils::LongNumberType right = element_hash(index + 1);
+		state_hash -= pair_hash(left, token.hash()) + pair_hash(token.hash(), right);
+		token.set_data<PointerDataType>(pointer);
+		state_hash += pair_hash(left, token.hash()) + pair_hash(token.hash(), right);
+	} else {
+		token.set_data<PointerDataType>(pointer);
+	}
+	token.str = token.to_string();
+}
+
+// Patterns are at most 6 tokens long, so a change can only
+// create or break a pattern starting up to 5 tokens before it.
+void Interpreter::update_fused_marks(ProgramCounterType pos_begin, ProgramCounterType pos_end) {
+	if (fuse_instructions) {
+		Token::mark_fused(tokens, pos_begin >= 5 ? pos_begin - 5 : 0, pos_end);
+	}
+}
+
+bool Interpreter::find_cycle(ProgramCounterType iteration) {
+	trace::Scope scope(tracer.get(), "find_cycle", "cycle");
+	state_hash_history.push_back(state_hash);
+	if (state_hash_history.size() > cycle_detection_window * 2 + 1) {
+		state_hash_history.erase(state_hash_history.begin());
+	}
+	if (candidate_period > 0) {
+		if (iteration < candidate_iteration + candidate_period) {
+			return false;
+		}
+		// no object writes in between means objects and the heap are the same too
+		bool confirmed = tokens == candidate_tokens && object_write_count == candidate_write_count;
+		ProgramCounterType period = candidate_period;
+		candidate_period = 0;
+		candidate_tokens.clear();
+		if (confirmed) {
+			cycle_length = period;
+			cycle_entry_iteration = candidate_entry_iteration;
+			return true;
+		}
+	}
+	ProgramCounterType history_size = state_hash_history.size();
+	auto history = [&](ProgramCounterType age) {
+		return state_hash_history[history_size - 1 - age];
+	};
+	for (ProgramCounterType period = 1; period <= cycle_detection_window && period * 2 <= history_size - 1; period++) {
+		if (history(0) != history(period)) {
+			continue;
+		}
+		bool confirmed = true;
+		for (ProgramCounterType age = 1; age < period && confirmed; age++) {
+			confirmed = history(age) == history(age + period);
+		}
+		if (!confirmed) {
+			continue;
+		}
+		ProgramCounterType entry_age = period * 2 - 1;
+		while (entry_age + 1 + period < history_size && history(entry_age + 1) == history(entry_age + 1 + period)) {
+			entry_age++;
+		}
+		candidate_period = period;
+		candidate_iteration = iteration;
+		candidate_entry_iteration = iteration - entry_age;
+		candidate_write_count = object_write_count;
+		candidate_tokens = tokens;
+		return false;
+	}
+	return false;
+}
+
+// Returns the number of tokens inserted by the applied ops.
+ProgramCounterType Interpreter::exec_replace_ops(std::vector<ReplaceOp>& vec, OpPriority priority) {
+	ProgramCounterType applied_tokens = 0;
 	for (ReplaceOp& op : vec | std::views::reverse) {
 		if (index_shift[op.dst_begin].op_priority >= priority) {
 			continue;
 		}
+		applied_tokens += op.src_tokens.size();
 		delete_op_exec(op.dst_begin, op.dst_end, OP_TYPE_REPLACE);
-		insert_op_exec(op.src_begin, op.dst_begin, op.src_tokens, OP_TYPE_REPLACE);
+		insert_op_exec(op.src_begin, op.dst_begin, op.src_tokens, OP_TYPE_REPLACE, op.local_pointers);
 		for (ProgramCounterType token_i = op.dst_begin; token_i < op.dst_end; token_i++) {
 			index_shift[token_i].op_priority = priority;
 		}
 	}
+	return applied_tokens;
 }
 
+// Every op kind is traced as one span with the number of ops and the number of tokens they cover.
 void Interpreter::exec_pending_ops() {
+	trace::Scope scope(tracer.get(), "exec_pending_ops", "phase");
+	ProgramCounterType op_tokens = 0;
+	trace::Scope delete_scope(tracer.get(), "delete ops", "ops");
 	for (ProgramCounterType op_index = 0; op_index < delete_ops.size(); op_index++) {
 		DeleteOp& op = delete_ops[op_index];
 		if (index_shift[op.pos_begin].is_strongly_deleted()) {
 			continue;
 		}
+		op_tokens += op.pos_end - op.pos_begin;
 		delete_op_exec(op.pos_begin, op.pos_end, OP_TYPE_NORMAL);
 		OpPriority header_priority = op.priority;
 		OpPriority remaining_priority = op.priority;
@@ -865,28 +1626,37 @@ void Interpreter::exec_pending_ops() {
 			index_shift[token_i].op_priority = remaining_priority;
 		}
 	}
+	end_op_scope(delete_scope, delete_ops.size(), op_tokens);
+	trace::Scope insert_scope(tracer.get(), "insert ops", "ops");
 	for (ProgramCounterType op_index = 0; op_index < insert_ops.size(); op_index++) {
 		InsertOp& op = insert_ops[op_index];
+		op_tokens += op.insert_tokens.size();
 		insert_op_exec(op.src_pos, op.dst_pos, op.insert_tokens, OP_TYPE_NORMAL);
 	}
+	end_op_scope(insert_scope, insert_ops.size(), op_tokens);
+	trace::Scope move_scope(tracer.get(), "move ops", "ops");
 	for (MoveOp& op : move_ops | std::views::reverse) {
 		if (index_shift[op.old_begin].op_priority >= OP_PRIORITY_MOVE) {
 			continue;
 		}
-		std::vector<Token> tokens_to_move(prev_tokens.begin() + op.old_begin, prev_tokens.begin() + op.old_end);
+		op_tokens += op.old_end - op.old_begin;
+		TokenSpan tokens_to_move(&prev_tokens, op.old_begin, op.old_end);
 		delete_op_exec(op.old_begin, op.old_end, OP_TYPE_MOVE);
 		insert_op_exec(op.old_begin, op.new_begin, tokens_to_move, OP_TYPE_MOVE);
 		for (ProgramCounterType token_i = op.old_begin; token_i < op.old_end; token_i++) {
 			index_shift[token_i].op_priority = OP_PRIORITY_MOVE;
 		}
 	}
+	end_op_scope(move_scope, move_ops.size(), op_tokens);
+	trace::Scope movereplace_scope(tracer.get(), "movereplace ops", "ops");
 	for (MoveReplaceOp& op : movereplace_ops | std::views::reverse) {
 		IndexShiftEntry ise = index_shift[op.new_begin];
 		delete_op_exec(op.old_begin, op.old_end, OP_TYPE_MOVE);
 		if (ise.is_strongly_deleted() || ise.is_replaced()) {
 			continue;
 		}
-		std::vector<Token> tokens_to_move(prev_tokens.begin() + op.old_begin, prev_tokens.begin() + op.old_end);
+		op_tokens += op.old_end - op.old_begin;
+		TokenSpan tokens_to_move(&prev_tokens, op.old_begin, op.old_end);
 		delete_op_exec(op.new_begin, op.new_end, OP_TYPE_REPLACE);
 		insert_op_exec(op.old_begin, op.new_begin, tokens_to_move, OP_TYPE_MOVEREPLACE);
 		for (ProgramCounterType token_i = op.old_begin; token_i < op.old_end; token_i++) {
@@ -896,11 +1666,269 @@ void Interpreter::exec_pending_ops() {
 			index_shift[token_i].op_priority = OP_PRIORITY_REPLACE;
 		}
 	}
-	exec_replace_ops(replace_ops, OP_PRIORITY_REPLACE);
-	exec_replace_ops(func_replace_ops, OP_PRIORITY_FUNC_REPLACE);
+	end_op_scope(movereplace_scope, movereplace_ops.size(), op_tokens);
+	trace::Scope replace_scope(tracer.get(), "replace ops", "ops");
+	op_tokens = exec_replace_ops(replace_ops, OP_PRIORITY_REPLACE);
+	end_op_scope(replace_scope, replace_ops.size(), op_tokens);
+	trace::Scope func_replace_scope(tracer.get(), "func replace ops", "ops");
+	op_tokens = exec_replace_ops(func_replace_ops, OP_PRIORITY_FUNC_REPLACE);
+	end_op_scope(func_replace_scope, func_replace_ops.size(), op_tokens);
+	trace::Scope object_scope(tracer.get(), "object ops", "ops");
+	exec_object_ops();
+	if (object_ops.size() > 0) {
+		object_scope.arg("count", object_ops.size());
+		object_scope.end();
+	} else {
+		object_scope.discard();
+	}
+	trace::Scope shift_scope(tracer.get(), "shift_pointers", "phase");
 	shift_pointers();
 }
 
+// Ends the span of one op kind and starts counting tokens for the next one, op kinds without ops are not traced.
+void Interpreter::end_op_scope(trace::Scope& scope, ProgramCounterType op_count, ProgramCounterType& op_tokens) {
+	if (op_count > 0) {
+		scope.arg("count", op_count);
+		scope.arg("tokens", op_tokens);
+		scope.end();
+	} else {
+		scope.discard();
+	}
+	op_tokens = 0;
+}
+
+// Object writes are applied in scan order after all token ops,
+// so every read during the scan sees the contents from the previous iteration.
+void Interpreter::exec_object_ops() {
+	for (ObjectOp& op : object_ops) {
+		op.write(*op.object);
+		hash_external_write();
+	}
+}
+
+// Runs one iteration of every block found by the sweep on the interpreter of the block. Blocks share
+// no tokens, so they run in parallel on up to block_threads worker threads. The interpreter keeps the
+// contents and takes them over again only when the enclosing program changed them. A block whose
+// contents changed is rewritten by one replace op, which ops of the enclosing program on the same
+// tokens take precedence over.
+void Interpreter::exec_blocks() {
+	if (block_interpreters.size() > block_list.size()) {
+		remove_block_interpreters();
+	}
+	if (block_list.empty()) {
+		return;
+	}
+	trace::Scope scope(tracer.get(), "exec_blocks", "phase");
+	scope.arg("blocks", block_list.size());
+	std::vector<Interpreter*> blocks(block_list.size());
+	std::vector<bool> synced(block_list.size());
+	std::vector<utils::LongNumberType> write_counts(block_list.size());
+	std::vector<std::exception_ptr> errors(block_list.size());
+	std::set<Uint64Type> seen_ids;
+	for (ProgramCounterType block_i = 0; block_i < block_list.size(); block_i++) {
+		ProgramCounterType header_index = block_list[block_i];
+		Uint64Type id = prev_tokens[header_index].block_id;
+		std::shared_ptr<Interpreter> block;
+		auto it = block_interpreters.find(id);
+		if (it != block_interpreters.end()) {
+			block = it->second;
+		}
+		if (!block || !seen_ids.insert(id).second) {
+			// a new block starts from its contents, a copy of a block that ran starts where the original is
+			block = block ? std::make_shared<Interpreter>(*block) : std::shared_ptr<Interpreter>(new Interpreter({}, *this));
+			id = next_block_id++;
+			seen_ids.insert(id);
+			block_interpreters[id] = block;
+			prev_tokens[header_index].block_id = id;
+			tokens[header_index].block_id = id;
+			synced[block_i] = true;
+		}
+		blocks[block_i] = block.get();
+		write_counts[block_i] = block->object_write_count;
+	}
+	auto run_block = [&](ProgramCounterType block_i) {
+		try {
+			ProgramCounterType header_index = block_list[block_i];
+			trace::Scope block_scope(tracer.get(), "block", "block");
+			block_scope.arg("header", header_index);
+			Interpreter& block = *blocks[block_i];
+			auto contents_begin = prev_tokens.begin() + header_index + 1;
+			auto contents_end = prev_tokens.begin() + prev_tokens[header_index].last_index;
+			// unchanged contents are the tokens the block ended its last iteration with
+			if (synced[block_i] || prev_tokens[header_index].subtree_changed) {
+				bool same = block.tokens.size() == contents_end - contents_begin
+					&& std::equal(contents_begin, contents_end, block.tokens.begin());
+				if (!same) {
+					block.tokens.assign(contents_begin, contents_end);
+					for (Token& token : block.tokens) {
+						token.changed = true;
+					}
+				}
+			}
+			block.execute();
+		} catch (...) {
+			errors[block_i] = std::current_exception();
+		}
+	};
+	ProgramCounterType thread_count = std::min<ProgramCounterType>(block_threads, block_list.size());
+	if (thread_count <= 1) {
+		for (ProgramCounterType block_i = 0; block_i < block_list.size(); block_i++) {
+			run_block(block_i);
+		}
+	} else {
+		if (!block_pool || block_pool->get_thread_count() < thread_count) {
+			block_pool.reset();
+			block_pool = std::make_shared<WorkerPool>(thread_count);
+		}
+		block_pool->run(block_list.size(), run_block);
+	}
+	for (ProgramCounterType block_i = 0; block_i < block_list.size(); block_i++) {
+		if (errors[block_i]) {
+			try {
+				std::rethrow_exception(errors[block_i]);
+			} catch (std::exception exc) {
+				throw std::runtime_error("Block at " + std::to_string(block_list[block_i]) + ": " + std::string(exc.what()));
+			}
+		}
+		Interpreter& block = *blocks[block_i];
+		if (block.tokens_changed) {
+			ProgramCounterType contents_begin = block_list[block_i] + 1;
+			ProgramCounterType contents_end = prev_tokens[block_list[block_i]].last_index;
+			replace_tokens_func(contents_begin, contents_end, contents_begin, block.tokens);
+			func_replace_ops.back().local_pointers = true;
+		}
+		if (block.object_write_count != write_counts[block_i]) {
+			// the state of the block is part of the state of the program
+			hash_external_write();
+		}
+		local_print_buffer += block.local_print_buffer;
+	}
+}
+
+// Drops the interpreters of blocks that are no longer in the program.
+void Interpreter::remove_block_interpreters() {
+	std::set<Uint64Type> present_ids;
+	for (Token& token : prev_tokens) {
+		if ((token.node_flags & NODE_BLOCK) && token.block_id != 0) {
+			present_ids.insert(token.block_id);
+		}
+	}
+	std::erase_if(block_interpreters, [&](const auto& entry) {
+		return !present_ids.contains(entry.first);
+	});
+}
+
+// State outside of the token list changed, so the same tokens no longer mean the same state.
+void Interpreter::hash_external_write() {
+	object_write_count++;
+	if (detect_cycles) {
+		state_hash += utils::hash_mix(object_write_count);
+	}
+}
+
+// Deletes top level subtrees that are plain data (values, lists of values or quoted code)
+// and cannot be reached from any other top level subtree. Subtrees with instructions are roots,
+// pointers and number arguments of instructions reach the subtree their target belongs to,
+// counted from the argument and from the instruction. Nothing is collected while an argument
+// is computed by another instruction, as the address it gives is not known yet.
+// Nothing is deleted once there are no instructions left, so a program that ends
+// with only data keeps it as its result. Returns the number of deleted tokens.
+ProgramCounterType Interpreter::collect_unreachable() {
+	try {
+		trace::Scope scope(tracer.get(), "collect_unreachable", "gc");
+		parse(0, false);
+		// parse folded the change marks into subtree_changed, putting them back keeps
+		// the next parse from skipping blocked instructions whose arguments changed
+		for (Token& token : tokens) {
+			token.changed = token.subtree_changed;
+		}
+		prev_tokens = tokens;
+		reset_index_shift();
+		std::vector<PointerDataType> root_of(prev_tokens.size());
+		std::vector<bool> is_data(prev_tokens.size(), true);
+		for (ProgramCounterType token_i = 0; token_i < prev_tokens.size(); token_i++) {
+			Token& current_token = prev_tokens[token_i];
+			PointerDataType root = current_token.has_parent() ? root_of[current_token.parent_index] : token_i;
+			root_of[token_i] = root;
+			bool plain_list = (current_token.node_flags & (NODE_CONTAINER | NODE_ORDERED | NODE_SEQ)) == (NODE_CONTAINER | NODE_ORDERED);
+			if (
+				!(prev_tokens[root].node_flags & NODE_QUOTE)
+				&& !current_token.is_value() && !plain_list && !(current_token.node_flags & NODE_END)
+			) {
+				is_data[root] = false;
+			}
+		}
+		std::vector<bool> reachable(prev_tokens.size(), false);
+		std::vector<PointerDataType> root_stack;
+		for (ProgramCounterType token_i = 0; token_i < prev_tokens.size(); token_i = prev_tokens[token_i].last_index + 1) {
+			if (!is_data[token_i]) {
+				reachable[token_i] = true;
+				root_stack.push_back(token_i);
+			}
+		}
+		if (root_stack.empty()) {
+			// nothing can run anymore, what is left is the result of the program
+			return 0;
+		}
+		while (!root_stack.empty()) {
+			PointerDataType root = root_stack.back();
+			root_stack.pop_back();
+			for (ProgramCounterType token_i = root; token_i <= prev_tokens[root].last_index; token_i++) {
+				Token& current_token = prev_tokens[token_i];
+				bool is_argument = current_token.has_parent() && !(current_token.parent_flags & NODE_CONTAINER);
+				if (
+					is_argument && !current_token.is_value()
+					&& !(current_token.node_flags & (NODE_CONTAINER | NODE_QUOTE))
+				) {
+					return 0;
+				}
+				if (!current_token.is_ptr() && !(current_token.is_num() && is_argument)) {
+					continue;
+				}
+				PointerDataType offset = current_token.get_data_cast<PointerDataType>();
+				auto reach = [&](PointerDataType target) {
+					if (target != prev_tokens.size() && !reachable[root_of[target]]) {
+						reachable[root_of[target]] = true;
+						root_stack.push_back(root_of[target]);
+					}
+				};
+				if (current_token.is_ptr()) {
+					// pointers are shifted when tokens between them and their target are deleted
+					reach(token_index(prev_tokens, token_i + offset));
+					continue;
+				}
+				// numbers are not, so everything they span is kept, and an address that wraps
+				// around the program would change with its size
+				for (PointerDataType base : { (PointerDataType)token_i, current_token.parent_index }) {
+					PointerDataType target = base + offset;
+					if (target < 0 || target > (PointerDataType)prev_tokens.size()) {
+						return 0;
+					}
+					PointerDataType end = std::max(base, target);
+					for (PointerDataType span_i = root_of[std::min(base, target)]; span_i <= end && span_i < prev_tokens.size(); span_i = prev_tokens[span_i].last_index + 1) {
+						reach(span_i);
+					}
+				}
+			}
+		}
+		ProgramCounterType collected = 0;
+		for (ProgramCounterType token_i = 0; token_i < prev_tokens.size(); token_i = prev_tokens[token_i].last_index + 1) {
+			if (!reachable[token_i]) {
+				delete_tokens(token_i, prev_tokens[token_i].last_index + 1, OP_PRIORITY_STRONG_DELETE);
+				collected += prev_tokens[token_i].last_index + 1 - token_i;
+			}
+		}
+		if (collected > 0) {
+			exec_pending_ops();
+		}
+		gc_collected_count += collected;
+		scope.arg("collected", collected);
+		return collected;
+	} catch (std::exception exc) {
+		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
+	}
+}
+
 void Interpreter::reset_index_shift() {
 		index_shift = std::vector<IndexShiftEntry>(tokens.size() + 1);
 		index_shift_rev = std::vector<PointerDataType>(tokens.size() + 1);
@@ -914,7 +1942,9 @@ void Interpreter::reset_index_shift() {
 		func_replace_ops.clear();
 		move_ops.clear();
 		movereplace_ops.clear();
+		object_ops.clear();
 		new_pointers.clear();
+		op_tokens.clear();
 		scope_list = std::vector<ScopeListEntry>();
 }
 
@@ -956,15 +1986,14 @@ void Interpreter::shift_pointers() {
 				}
 			}
 			PointerDataType new_pointer = new_dst - new_index;
-			current_token.set_data<PointerDataType>(new_pointer);
-			current_token.str = current_token.to_string();
+			set_pointer_value(token_i, new_pointer);
 		}
 	}
 }
 
 bool Interpreter::unary_func(std::function<Token(Token)> func) {
 	if (rel_token(prev_tokens, 1).is_num_or_ptr()) {
-		Token& arg = rel_token(prev_tokens, 1);
+		Token arg = rel_token(prev_tokens, 1);
 		if (arg.is_ptr()) {
 			arg.set_data<PointerDataType>(arg.get_data<PointerDataType>() + 1);
 		}
@@ -975,13 +2004,13 @@ bool Interpreter::unary_func(std::function<Token(Token)> func) {
 		replace_tokens_func(program_counter, program_counter + 2, program_counter, { result });
 		return true;
 	}
-	return false;
+	return sequence_unary_func(func);
 }
 
 bool Interpreter::binary_func(std::function<Token(Token, Token)> func) {
 	if (rel_token(prev_tokens, 1).is_num_or_ptr() && rel_token(prev_tokens, 2).is_num_or_ptr()) {
-		Token& arg1 = rel_token(prev_tokens, 1);
-		Token& arg2 = rel_token(prev_tokens, 2);
+		Token arg1 = rel_token(prev_tokens, 1);
+		Token arg2 = rel_token(prev_tokens, 2);
 		if (arg1.is_ptr()) {
 			arg1.set_data<PointerDataType>(arg1.get_data<PointerDataType>() + 1);
 		}
@@ -995,9 +2024,401 @@ bool Interpreter::binary_func(std::function<Token(Token, Token)> func) {
 		replace_tokens_func(program_counter, program_counter + 3, program_counter, { result });
 		return true;
 	}
+	return sequence_binary_func(func);
+}
+
+ProgramCounterType Interpreter::MathOperand::size() const {
+	if (!is_sequence) {
+		return 1;
+	}
+	return typed_elements ? typed_elements->size() : mixed_elements.size();
+}
+
+Token Interpreter::MathOperand::get(ProgramCounterType index) const {
+	if (!is_sequence) {
+		return scalar;
+	}
+	return typed_elements ? typed_elements->get(index) : mixed_elements[index];
+}
+
+token_type Interpreter::MathOperand::get_type() const {
+	return typed_elements ? typed_elements->elem_type : type_unknown;
+}
+
+bool Interpreter::MathOperand::is_typed() const {
+	return typed_elements != nullptr;
+}
+
+const void* Interpreter::MathOperand::data() const {
+	const PackedArray& elements = *typed_elements;
+	return elements.data();
+}
+
+// Numbers, arrays and lists that contain only numbers can be math function arguments.
+// Typed elements are used when all elements have one type, so they can go to simd kernels.
+bool Interpreter::get_math_operand(ProgramCounterType index, MathOperand& operand) {
+	Token& token = prev_tokens[index];
+	if (token.is_num()) {
+		operand.scalar = token;
+		operand.typed_elements = std::make_shared<PackedArray>(token.type);
+		operand.typed_elements->insert(0, token);
+		return true;
+	} else if (token.is_object()) {
+		operand.typed_elements = std::dynamic_pointer_cast<PackedArray>(token.object);
+		operand.is_sequence = true;
+		operand.is_array = true;
+		return operand.typed_elements != nullptr;
+	} else if (token.str == "list") {
+		bool same_type = true;
+		for (ProgramCounterType elem_i = index + 1; elem_i < token.last_index; elem_i++) {
+			if (!prev_tokens[elem_i].is_num()) {
+				return false;
+			}
+			same_type = same_type && prev_tokens[elem_i].type == prev_tokens[index + 1].type;
+		}
+		operand.is_sequence = true;
+		if (same_type && token.last_index > index + 1) {
+			operand.typed_elements = std::make_shared<PackedArray>(prev_tokens[index + 1].type);
+			operand.typed_elements->resize(token.last_index - index - 1);
+			for (ProgramCounterType elem_i = index + 1; elem_i < token.last_index; elem_i++) {
+				operand.typed_elements->set(elem_i - index - 1, prev_tokens[elem_i]);
+			}
+		} else {
+			operand.mixed_elements.assign(prev_tokens.begin() + index + 1, prev_tokens.begin() + token.last_index);
+		}
+		return true;
+	}
 	return false;
 }
 
+// Replaces the current instruction with an array if one of the arguments was an array, or with a list otherwise.
+void Interpreter::replace_with_sequence(ProgramCounterType end, bool as_array, std::vector<Token> elements, std::shared_ptr<PackedArray> typed_elements) {
+	if (as_array) {
+		if (!typed_elements) {
+			token_type elem_type = elements.size() > 0 ? elements[0].type : type_int32;
+			for (ProgramCounterType elem_i = 1; elem_i < elements.size(); elem_i++) {
+				elem_type = Token::get_return_type(elem_type, elements[elem_i].type);
+			}
+			typed_elements = std::make_shared<PackedArray>(elem_type);
+			for (ProgramCounterType elem_i = 0; elem_i < elements.size(); elem_i++) {
+				typed_elements->insert(elem_i, elements[elem_i]);
+			}
+		}
+		replace_tokens_func(program_counter, end, program_counter, { Token(typed_elements) });
+	} else {
+		std::vector<Token> results;
+		results.push_back(Token("list"));
+		if (typed_elements) {
+			for (ProgramCounterType elem_i = 0; elem_i < typed_elements->size(); elem_i++) {
+				results.push_back(typed_elements->get(elem_i));
+			}
+		} else {
+			results.insert(results.end(), elements.begin(), elements.end());
+		}
+		results.push_back(Token("end"));
+		replace_tokens_func(program_counter, end, program_counter, results);
+	}
+}
+
+bool Interpreter::sequence_unary_func(std::function<Token(Token)> func) {
+	Token& node = prev_tokens[program_counter];
+	MathOperand arg;
+	if (child_count(program_counter) < 1 || !get_math_operand(child_at(program_counter, 0), arg) || !arg.is_sequence) {
+		return false;
+	}
+	simd::UnaryKernel kernel = arg.is_typed() ? simd::get_unary_kernel(node.str, arg.get_type()) : nullptr;
+	if (kernel) {
+		std::shared_ptr<PackedArray> result = std::make_shared<PackedArray>(arg.get_type());
+		result->resize(arg.size());
+		kernel(arg.data(), result->data(), arg.size());
+		replace_with_sequence(node.last_index + 1, arg.is_array, {}, result);
+		return true;
+	}
+	std::vector<Token> results(arg.size());
+	for (ProgramCounterType elem_i = 0; elem_i < arg.size(); elem_i++) {
+		results[elem_i] = func(arg.get(elem_i));
+	}
+	replace_with_sequence(node.last_index + 1, arg.is_array, results, nullptr);
+	return true;
+}
+
+// Applies the function element-wise, a number argument is used for every element.
+bool Interpreter::sequence_binary_func(std::function<Token(Token, Token)> func) {
+	Token& node = prev_tokens[program_counter];
+	MathOperand first;
+	MathOperand second;
+	if (
+		child_count(program_counter) < 2
+		|| !get_math_operand(child_at(program_counter, 0), first)
+		|| !get_math_operand(child_at(program_counter, 1), second)
+		|| !first.is_sequence && !second.is_sequence
+	) {
+		return false;
+	}
+	if (first.is_sequence && second.is_sequence && first.size() != second.size()) {
+		throw std::runtime_error(
+			"Argument sizes do not match: " + std::to_string(first.size()) + " " + std::to_string(second.size())
+		);
+	}
+	ProgramCounterType count = first.is_sequence ? first.size() : second.size();
+	bool as_array = first.is_array || second.is_array;
+	simd::BinaryKernel kernel = nullptr;
+	if (first.is_typed() && second.is_typed() && first.get_type() == second.get_type()) {
+		kernel = simd::get_binary_kernel(node.str, first.get_type());
+	}
+	if (kernel) {
+		std::shared_ptr<PackedArray> result = std::make_shared<PackedArray>(simd::get_binary_result_type(node.str, first.get_type()));
+		result->resize(count);
+		kernel(first.data(), !first.is_sequence, second.data(), !second.is_sequence, result->data(), count);
+		replace_with_sequence(node.last_index + 1, as_array, {}, result);
+	} else {
+		std::vector<Token> results(count);
+		for (ProgramCounterType elem_i = 0; elem_i < count; elem_i++) {
+			results[elem_i] = func(first.get(elem_i), second.get(elem_i));
+		}
+		replace_with_sequence(node.last_index + 1, as_array, results, nullptr);
+	}
+	return true;
+}
+
+// sum, min, max and dot of lists and arrays.
+// Folds left to right with the Token functions, kernels are only used where that gives the same result.
+bool Interpreter::reduce_func(std::string op) {
+	Token& node = prev_tokens[program_counter];
+	bool is_dot = op == "dot";
+	MathOperand first;
+	MathOperand second;
+	if (
+		child_count(program_counter) < (is_dot ? 2 : 1)
+		|| !get_math_operand(child_at(program_counter, 0), first)
+		|| is_dot && !get_math_operand(child_at(program_counter, 1), second)
+	) {
+		return false;
+	}
+	ProgramCounterType count = first.size();
+	if (is_dot && second.size() != count) {
+		throw std::runtime_error(
+			"Argument sizes do not match: " + std::to_string(first.size()) + " " + std::to_string(second.size())
+		);
+	}
+	if ((op == "min" || op == "max") && count == 0) {
+		throw std::runtime_error("Empty list in " + op);
+	}
+	simd::ReduceKernel kernel = nullptr;
+	if (first.is_typed() && (!is_dot || second.is_typed() && second.get_type() == first.get_type())) {
+		kernel = simd::get_reduce_kernel(op, first.get_type());
+	}
+	Token result;
+	if (kernel) {
+		PackedArray result_array(first.get_type());
+		result_array.resize(1);
+		kernel(first.data(), is_dot ? second.data() : nullptr, count, result_array.data());
+		result = result_array.get(0);
+	} else if (count == 0) {
+		result = Token("0");
+	} else {
+		result = is_dot ? Token::mul(first.get(0), second.get(0)) : first.get(0);
+		for (ProgramCounterType elem_i = 1; elem_i < count; elem_i++) {
+			Token current = first.get(elem_i);
+			if (op == "sum") {
+				result = Token::add(result, current);
+			} else if (op == "min") {
+				result = Token::lt(current, result).get_data<Int32Type>() ? current : result;
+			} else if (op == "max") {
+				result = Token::gt(current, result).get_data<Int32Type>() ? current : result;
+			} else {
+				result = Token::add(result, Token::mul(current, second.get(elem_i)));
+			}
+		}
+	}
+	replace_tokens_func(program_counter, node.last_index + 1, program_counter, { result });
+	return true;
+}
+
+// Elements of a list argument, only lists of numbers are accepted.
+bool Interpreter::get_list_elements(ProgramCounterType index, std::vector<Token>& elements) {
+	Token& token = prev_tokens[index];
+	if (token.str != "list") {
+		return false;
+	}
+	for (ProgramCounterType elem_i = index + 1; elem_i < token.last_index; elem_i++) {
+		if (!prev_tokens[elem_i].is_num()) {
+			return false;
+		}
+	}
+	elements.assign(prev_tokens.begin() + index + 1, prev_tokens.begin() + token.last_index);
+	return true;
+}
+
+// len, getsize and find read the subtree a pointer points to,
+// slice, concat, reverse and sort replace themselves with a new list in one op.
+bool Interpreter::list_func(std::string op) {
+	Token& node = prev_tokens[program_counter];
+	auto make_int = [](PointerDataType value) {
+		Token result;
+		result.type = type_int64;
+		result.set_data<Int64Type>(value);
+		result.str = result.to_string();
+		return result;
+	};
+	if (op == "len" || op == "getsize" || op == "find") {
+		if (!rel_token(prev_tokens, 1).is_num_or_ptr() || op == "find" && !rel_token(prev_tokens, 2).is_num()) {
+			return false;
+		}
+		PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+		ProgramCounterType target_index = token_index(prev_tokens, program_counter + 1 + arg);
+		ProgramCounterType end = program_counter + (op == "find" ? 3 : 2);
+		if (target_index == prev_tokens.size() || prev_tokens[target_index].str == "end") {
+			delete_tokens(program_counter, end, OP_PRIORITY_WEAK_DELETE);
+			return true;
+		}
+		Token& target = prev_tokens[target_index];
+		if (op == "getsize") {
+			replace_tokens_func(program_counter, end, program_counter, { make_int(target.last_index - target_index + 1) });
+		} else if (!target.is_container_header()) {
+			delete_tokens(program_counter, end, OP_PRIORITY_WEAK_DELETE);
+		} else if (op == "len") {
+			replace_tokens_func(program_counter, end, program_counter, { make_int(child_count(target_index) - 1) });
+		} else {
+			Token value = rel_token(prev_tokens, 2);
+			PointerDataType found = -1;
+			for (ProgramCounterType arg_i = 0; arg_i + 1 < child_count(target_index); arg_i++) {
+				Token& elem = prev_tokens[child_at(target_index, arg_i)];
+				if (elem.is_num() && Token::cmp(elem, value).get_data<Int32Type>()) {
+					found = arg_i;
+					break;
+				}
+			}
+			replace_tokens_func(program_counter, end, program_counter, { make_int(found) });
+		}
+		return true;
+	}
+	std::vector<Token> elements;
+	if (op == "slice") {
+		if (
+			child_count(program_counter) < 3
+			|| !prev_tokens[child_at(program_counter, 0)].is_num()
+			|| !prev_tokens[child_at(program_counter, 1)].is_num()
+			|| !get_list_elements(child_at(program_counter, 2), elements)
+		) {
+			return false;
+		}
+		PointerDataType size = elements.size();
+		PointerDataType begin = std::clamp<PointerDataType>(prev_tokens[child_at(program_counter, 0)].get_data_cast<PointerDataType>(), 0, size);
+		PointerDataType end = std::clamp<PointerDataType>(prev_tokens[child_at(program_counter, 1)].get_data_cast<PointerDataType>(), begin, size);
+		elements = std::vector<Token>(elements.begin() + begin, elements.begin() + end);
+	} else if (op == "concat") {
+		std::vector<Token> second;
+		if (
+			child_count(program_counter) < 2
+			|| !get_list_elements(child_at(program_counter, 0), elements)
+			|| !get_list_elements(child_at(program_counter, 1), second)
+		) {
+			return false;
+		}
+		elements.insert(elements.end(), second.begin(), second.end());
+	} else {
+		if (child_count(program_counter) < 1 || !get_list_elements(child_at(program_counter, 0), elements)) {
+			return false;
+		}
+		if (op == "reverse") {
+			std::reverse(elements.begin(), elements.end());
+		} else {
+			std::stable_sort(elements.begin(), elements.end(), [](const Token& a, const Token& b) {
+				return Token::lt(a, b).get_data<Int32Type>() != 0;
+			});
+		}
+	}
+	replace_with_sequence(node.last_index + 1, false, elements, nullptr);
+	return true;
+}
+
 bool operator<(const Interpreter::NewPointersEntry& left, const Interpreter::NewPointersEntry& right) {
 	return left.index < right.index;
-}
\ No newline at end of file
+}
+
+// next, prev, up and down replace themselves with a pointer to the next or previous sibling,
+// the parent or the first argument of the subtree their argument points to,
+// getaddr with its absolute index. They delete themselves if there is no such subtree.
+bool Interpreter::nav_func(std::string op) {
+	if (!rel_token(prev_tokens, 1).is_num_or_ptr()) {
+		return false;
+	}
+	PointerDataType arg = rel_token(prev_tokens, 1).get_data_cast<PointerDataType>();
+	PointerDataType target_index = token_index(prev_tokens, program_counter + 1 + arg);
+	if (target_index == prev_tokens.size() || prev_tokens[target_index].node_flags & NODE_END) {
+		delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
+		return true;
+	}
+	Token& target = prev_tokens[target_index];
+	Token result;
+	if (op == "getaddr") {
+		result.type = type_int64;
+		result.set_data<Int64Type>(target_index);
+		result.str = result.to_string();
+		replace_tokens_func(program_counter, program_counter + 2, program_counter, { result });
+		return true;
+	}
+	PointerDataType found = -1;
+	if (op == "next") {
+		PointerDataType next_index = target.last_index + 1;
+		bool inside_parent = !target.has_parent() || next_index <= prev_tokens[target.parent_index].last_index;
+		if (next_index < prev_tokens.size() && inside_parent && !(prev_tokens[next_index].node_flags & NODE_END)) {
+			found = next_index;
+		}
+	} else if (op == "prev") {
+		// the token before a subtree is either its parent or the last token of the previous sibling
+		PointerDataType prev_index = target_index - 1;
+		if (prev_index >= 0 && prev_index != target.parent_index) {
+			while (prev_tokens[prev_index].parent_index != target.parent_index) {
+				prev_index = prev_tokens[prev_index].parent_index;
+			}
+			found = prev_index;
+		}
+	} else if (op == "up") {
+		found = target.parent_index;
+	} else if (op == "down") {
+		if (child_count(target_index) > 0 && !(prev_tokens[child_at(target_index, 0)].node_flags & NODE_END)) {
+			found = child_at(target_index, 0);
+		}
+	}
+	if (found < 0) {
+		delete_tokens(program_counter, program_counter + 2, OP_PRIORITY_WEAK_DELETE);
+		return true;
+	}
+	result.type = type_ptr;
+	result.set_data<PointerDataType>(found - (PointerDataType)program_counter);
+	result.str = result.to_string();
+	new_pointers.insert(NewPointersEntry(program_counter, result.get_data_cast<PointerDataType>()));
+	replace_tokens_func(program_counter, program_counter + 2, program_counter, { result });
+	return true;
+}
+
+// Native instructions wait until every argument is a number or a list of numbers,
+// then replace themselves with the tokens the function returns.
+bool Interpreter::native_func(const NativeFunction& function) {
+	std::vector<NativeArg> args(child_count(program_counter));
+	for (ProgramCounterType arg_i = 0; arg_i < args.size(); arg_i++) {
+		PointerDataType arg_index = child_at(program_counter, arg_i);
+		if (prev_tokens[arg_index].is_num()) {
+			args[arg_i].number = prev_tokens[arg_index];
+		} else if (get_list_elements(arg_index, args[arg_i].elements)) {
+			args[arg_i].is_list = true;
+		} else {
+			return false;
+		}
+	}
+	std::vector<Token> results;
+	try {
+		results = function(args);
+	} catch (std::exception exc) {
+		throw std::runtime_error(prev_tokens[program_counter].str + ": " + std::string(exc.what()));
+	}
+	for (Token& result : results) {
+		if (result.is_num_or_ptr()) {
+			result.str = result.to_string();
+		}
+	}
+	replace_tokens_func(program_counter, prev_tokens[program_counter].last_index + 1, program_counter, results);
+	return true;
+}
@@ -8,10 +8,21 @@
 #include <algorithm>
 #include <ranges>
 #include <set>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
 #include <cassert>
 #include "token.h"
 #include "compiler.h"
+#include "filemap.h"
+#include "heap.h"
+#include "input.h"
+#include "jit.h"
+#include "native.h"
+#include "object.h"
+#include "trace.h"
 #include "utils.h"
+#include "worker_pool.h"
 
 class Interpreter {
 public:
@@ -25,15 +36,57 @@ public:
 	std::string local_print_buffer;
 	std::string global_print_buffer;
 	bool print_buffer_enabled = false;
+	// false keeps memory constant when printing over unbounded input
+	bool store_print_buffer = true;
 	bool print_iterations = false;
 	ProgramCounterType max_iterations = -1;
+	bool detect_cycles = false;
+	ProgramCounterType cycle_detection_window = 64;
+	ProgramCounterType cycle_length = 0;
+	ProgramCounterType cycle_entry_iteration = 0;
+	bool fuse_instructions = false;
+	// reduces pure function subtrees in one iteration, changes iteration counts but not results
+	bool eager_reduction = false;
+	// removes top level data that no instruction or pointer can reach anymore between iterations,
+	// printed output does not change, data left when no instructions remain is kept as the result
+	// but data dropped by earlier collections is not
+	bool collect_garbage = false;
+	// collection runs every gc_interval iterations, or after every iteration while there are more than gc_token_threshold tokens
+	ProgramCounterType gc_interval = 64;
+	ProgramCounterType gc_token_threshold = -1;
+	ProgramCounterType gc_collected_count = 0;
+	// Blocks run one iteration of their contents per iteration on worker threads, addresses inside
+	// a block wrap within it. Each block has its own heap and no input, its print output follows
+	// the output of the instructions outside of blocks.
+	ProgramCounterType block_threads = std::max(1u, std::thread::hardware_concurrency());
+	// compiles pure int32 arithmetic subtrees whose shape keeps coming back, as instances of a
+	// quoted template do, and reduces them in one step, changes iteration counts but not results
+	bool jit = false;
+	// evaluates every compiled subtree with the Token functions too and throws if the results differ
+	bool jit_verify = false;
+	jit::CodeCache jit_cache;
+	// records iterations, their phases, applied ops, blocks, cycle detection and collections when set,
+	// blocks record into the same recorder from their worker threads
+	std::shared_ptr<trace::Recorder> tracer;
+	// heap instructions take effect immediately in scan order, so a load sees every store to its left
+	// in the same iteration, token ops and object writes are still applied after the scan
+	Heap heap;
+	// read instructions wait for data, the program does not end while one of them is waiting
+	InputBuffer input;
 
 	Interpreter(std::string str);
+	Interpreter(std::string str, Compiler compiler);
+	// Parameters are bound before execute, copy an interpreter that was not executed yet
+	// to run the compiled program again with other parameters.
+	void bind(std::string name, Token value);
+	void bind_list(std::string name, std::vector<Token> elements);
 	void print_tokens(std::vector<Token>& token_list, bool print_program_counter = true);
 	void print_nodes();
 	std::vector<Token> execute();
 
 private:
+	Interpreter(std::vector<Token> tokens, const Interpreter& parent);
+
 	enum OpPriority {
 		OP_PRIORITY_NULL,
 		OP_PRIORITY_TEMP,
@@ -45,6 +98,18 @@ private:
 		OP_PRIORITY_REPLACE,
 		OP_PRIORITY_STRONG_DELETE,
 	};
+	class TokenSpan {
+	public:
+		std::vector<Token>* source = nullptr;
+		ProgramCounterType begin = 0;
+		ProgramCounterType end = 0;
+		TokenSpan();
+		TokenSpan(std::vector<Token>* source, ProgramCounterType begin, ProgramCounterType end);
+		ProgramCounterType size() const;
+		Token& operator[](ProgramCounterType index) const;
+		std::vector<Token>::iterator tokens_begin() const;
+		std::vector<Token>::iterator tokens_end() const;
+	};
 	class DeleteOp {
 	public:
 		ProgramCounterType pos_begin;
@@ -56,20 +121,22 @@ private:
 	public:
 		PointerDataType src_pos;
 		ProgramCounterType dst_pos;
-		std::vector<Token> insert_tokens;
+		TokenSpan insert_tokens;
 		bool recalc_pointers = true;
-		InsertOp(ProgramCounterType new_pos, std::vector<Token> insert_tokens);
-		InsertOp(ProgramCounterType src_pos, ProgramCounterType dst_pos, std::vector<Token> insert_tokens);
+		InsertOp(ProgramCounterType new_pos, TokenSpan insert_tokens);
+		InsertOp(ProgramCounterType src_pos, ProgramCounterType dst_pos, TokenSpan insert_tokens);
 	};
 	class ReplaceOp {
 	public:
 		ProgramCounterType dst_begin;
 		ProgramCounterType dst_end;
 		ProgramCounterType src_begin;
-		std::vector<Token> src_tokens;
+		TokenSpan src_tokens;
+		// pointers in src_tokens only point inside of them, as in the contents of a block
+		bool local_pointers = false;
 		ReplaceOp(
 			ProgramCounterType dst_begin, ProgramCounterType dst_end,
-			ProgramCounterType src_begin, std::vector<Token> src_tokens
+			ProgramCounterType src_begin, TokenSpan src_tokens
 		);
 	};
 	class MoveOp {
@@ -93,6 +160,12 @@ private:
 			ProgramCounterType new_begin, ProgramCounterType new_end
 		);
 	};
+	class ObjectOp {
+	public:
+		std::shared_ptr<TokenObject> object;
+		std::function<void(TokenObject&)> write;
+		ObjectOp(std::shared_ptr<TokenObject> object, std::function<void(TokenObject&)> write);
+	};
 	enum OpType {
 		OP_TYPE_NORMAL,
 		OP_TYPE_REPLACE,
@@ -129,13 +202,63 @@ private:
 	std::vector<ReplaceOp> func_replace_ops;
 	std::vector<MoveOp> move_ops;
 	std::vector<MoveReplaceOp> movereplace_ops;
+	std::vector<ObjectOp> object_ops;
 	std::set<NewPointersEntry> new_pointers;
+	std::vector<Token> op_tokens;
+	utils::LongNumberType state_hash = 0;
+	std::vector<utils::LongNumberType> state_hash_history;
+	// Hashes of different states can be equal, so a period found in the hashes is only a candidate.
+	// The tokens are kept and the cycle is reported only if they are the same one period later.
+	ProgramCounterType candidate_period = 0;
+	ProgramCounterType candidate_iteration = 0;
+	ProgramCounterType candidate_entry_iteration = 0;
+	utils::LongNumberType candidate_write_count = 0;
+	std::vector<Token> candidate_tokens;
+	utils::LongNumberType object_write_count = 0;
+	bool waiting_for_input = false;
+	std::vector<std::string> param_names;
+	std::vector<InstructionDataType> jit_shape;
+	std::vector<Int32Type> jit_leaves;
+	// headers of the blocks found by the sweep
+	std::vector<ProgramCounterType> block_list;
+	// Every block keeps its interpreter, and so its heap, JIT cache and nested blocks, for as long as
+	// its header is in the program. A copied block runs on a copy of the interpreter of the original.
+	std::unordered_map<Uint64Type, std::shared_ptr<Interpreter>> block_interpreters;
+	Uint64Type next_block_id = 1;
+	std::shared_ptr<WorkerPool> block_pool;
+	// set by execute when the last iteration changed the tokens
+	bool tokens_changed = false;
+	// tree of prev_tokens in compressed sparse row form, rebuilt by parse without per-token buffers:
+	// arguments of token i are child_indices[child_offsets[i]] .. child_indices[child_offsets[i + 1] - 1]
+	std::vector<ProgramCounterType> child_offsets;
+	std::vector<PointerDataType> child_indices;
 	struct RangePair {
 		ProgramCounterType first, last;
 	};
+	// argument of a math function: a number, a list of numbers or an array
+	struct MathOperand {
+		bool is_sequence = false;
+		bool is_array = false;
+		Token scalar;
+		// elements if they all have the same type, otherwise mixed_elements
+		std::shared_ptr<PackedArray> typed_elements;
+		std::vector<Token> mixed_elements;
+		ProgramCounterType size() const;
+		Token get(ProgramCounterType index) const;
+		token_type get_type() const;
+		bool is_typed() const;
+		const void* data() const;
+	};
 	void parse(ProgramCounterType index, bool one);
+	ProgramCounterType child_count(ProgramCounterType index);
+	PointerDataType child_at(ProgramCounterType index, ProgramCounterType arg_i);
 	bool try_execute_mod_instruction();
 	bool try_execute_func_instruction();
+	bool dispatch_instruction();
+	bool try_execute_fused_instruction(Token::FusedKind kind);
+	bool try_execute_eager_reduction();
+	bool try_execute_jit();
+	Token evaluate_pure_subtree(ProgramCounterType& index);
 	PointerDataType token_index(std::vector<Token>& token_list, PointerDataType index);
 	Token& get_token(std::vector<Token>& token_list, PointerDataType index);
 	Token& rel_token(std::vector<Token>& token_list, PointerDataType offset);
@@ -151,30 +274,61 @@ private:
 	bool parent_is_if();
 	PointerDataType to_dst_index(PointerDataType old_index);
 	PointerDataType to_src_index(PointerDataType new_index);
-	void insert_op_exec(PointerDataType old_src_pos, ProgramCounterType old_dst_pos, std::vector<Token> insert_tokens, OpType op_type);
+	TokenSpan subtree_span(ProgramCounterType index);
+	TokenSpan store_tokens(std::vector<Token> new_tokens);
+	void insert_op_exec(PointerDataType old_src_pos, ProgramCounterType old_dst_pos, const TokenSpan& insert_tokens, OpType op_type, bool local_pointers = false);
 	PointerDataType delete_op_exec(ProgramCounterType old_pos_begin, ProgramCounterType old_pos_end, OpType op_type);
 	void delete_tokens(ProgramCounterType pos_begin, ProgramCounterType pos_end, OpPriority priority);
-	void insert_tokens(ProgramCounterType old_pos, ProgramCounterType new_pos, std::vector<Token> insert_tokens);
+	void insert_tokens(ProgramCounterType old_pos, ProgramCounterType new_pos, TokenSpan insert_tokens);
 	void replace_tokens(
 		ProgramCounterType dst_begin, ProgramCounterType dst_end,
-		ProgramCounterType src_begin, std::vector<Token> src_tokens
+		ProgramCounterType src_begin, TokenSpan src_tokens
 	);
 	void replace_tokens_func(
 		ProgramCounterType dst_begin, ProgramCounterType dst_end,
 		ProgramCounterType src_begin, std::vector<Token> src_tokens
 	);
 	void move_tokens(ProgramCounterType old_begin, ProgramCounterType old_end, ProgramCounterType new_begin);
+	void write_object(ProgramCounterType index, std::function<void(TokenObject&)> write);
+	PackedArray* get_array(ProgramCounterType index);
+	HashMap* get_map(ProgramCounterType index);
+	FileView* get_file_view(ProgramCounterType index);
+	std::vector<Token> chars_to_list(std::string str);
+	void bind_subtree(std::string name, std::vector<Token> subtree);
 	void movereplace_tokens(
 		ProgramCounterType old_begin, ProgramCounterType old_end,
 		ProgramCounterType new_begin, ProgramCounterType new_end
 	);
-	void exec_replace_ops(std::vector<ReplaceOp>& vec, OpPriority priority);
+	utils::LongNumberType element_hash(PointerDataType index);
+	utils::LongNumberType pair_hash(utils::LongNumberType left, utils::LongNumberType right);
+	void reset_state_hash();
+	void hash_external_write();
+	void erase_token_range(ProgramCounterType pos_begin, ProgramCounterType pos_end);
+	void insert_token_range(ProgramCounterType pos, const TokenSpan& insert_tokens, bool clone_objects);
+	void set_pointer_value(ProgramCounterType index, PointerDataType pointer);
+	void update_fused_marks(ProgramCounterType pos_begin, ProgramCounterType pos_end);
+	bool find_cycle(ProgramCounterType iteration);
+	ProgramCounterType collect_unreachable();
+	ProgramCounterType exec_replace_ops(std::vector<ReplaceOp>& vec, OpPriority priority);
+	void end_op_scope(trace::Scope& scope, ProgramCounterType op_count, ProgramCounterType& op_tokens);
+	void exec_object_ops();
+	void exec_blocks();
+	void remove_block_interpreters();
 	void exec_pending_ops();
 	void reset_index_shift();
 	void print_node(Token& token);
 	void shift_pointers();
 	bool unary_func(std::function<Token(Token)> func);
 	bool binary_func(std::function<Token(Token, Token)> func);
+	bool get_math_operand(ProgramCounterType index, MathOperand& operand);
+	void replace_with_sequence(ProgramCounterType end, bool as_array, std::vector<Token> elements, std::shared_ptr<PackedArray> typed_elements);
+	bool sequence_unary_func(std::function<Token(Token)> func);
+	bool sequence_binary_func(std::function<Token(Token, Token)> func);
+	bool reduce_func(std::string op);
+	bool get_list_elements(ProgramCounterType index, std::vector<Token>& elements);
+	bool list_func(std::string op);
+	bool nav_func(std::string op);
+	bool native_func(const NativeFunction& function);
 
 };
 
@@ -0,0 +1,222 @@
+#include "jit.h"
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_X86_64
+#endif
+
+namespace jit {
+
+	enum JitOp {
+		JIT_NONE,
+		JIT_ADD,
+		JIT_SUB,
+		JIT_MUL,
+		JIT_CMP,
+		JIT_LT,
+		JIT_GT,
+		JIT_AND,
+		JIT_OR,
+		JIT_XOR,
+		JIT_NOT,
+	};
+
+	static JitOp get_op(InstructionDataType index) {
+		static const std::vector<JitOp> op_list = []() {
+			std::vector<JitOp> result;
+			for (const InstructionDef& def : INSTRUCTION_LIST) {
+				JitOp op = JIT_NONE;
+				if (def.str == "add") op = JIT_ADD;
+				else if (def.str == "sub") op = JIT_SUB;
+				else if (def.str == "mul") op = JIT_MUL;
+				else if (def.str == "cmp") op = JIT_CMP;
+				else if (def.str == "lt") op = JIT_LT;
+				else if (def.str == "gt") op = JIT_GT;
+				else if (def.str == "and") op = JIT_AND;
+				else if (def.str == "or") op = JIT_OR;
+				else if (def.str == "xor") op = JIT_XOR;
+				else if (def.str == "not") op = JIT_NOT;
+				result.push_back(op);
+			}
+			return result;
+		}();
+		if (index >= (InstructionDataType)op_list.size()) {
+			return JIT_NONE;
+		}
+		return op_list[index];
+	}
+
+	bool is_supported_instruction(InstructionDataType index) {
+#ifdef JIT_X86_64
+		return get_op(index) != JIT_NONE;
+#else
+		return false;
+#endif
+	}
+
+	CompiledFunc CodeCache::get(const std::vector<InstructionDataType>& shape) {
+#ifdef JIT_X86_64
+		Entry& entry = entries[shape];
+		if (entry.code) {
+			return entry.code->get_func();
+		}
+		if (entry.hits++ < hot_count) {
+			return nullptr;
+		}
+		entry.code = std::make_shared<CodeBuffer>(emit(shape));
+		compiled_count++;
+		return entry.code->get_func();
+#else
+		return nullptr;
+#endif
+	}
+
+	ProgramCounterType CodeCache::get_compiled_count() const {
+		return compiled_count;
+	}
+
+	std::size_t CodeCache::ShapeHash::operator()(const std::vector<InstructionDataType>& shape) const {
+		utils::LongNumberType hash = shape.size();
+		for (InstructionDataType index : shape) {
+			hash = utils::hash_mix(hash ^ (utils::LongNumberType)(Int64Type)index);
+		}
+		return hash;
+	}
+
+	// Evaluates the prefix expression on the machine stack: every leaf pushes its value,
+	// every instruction pops its arguments and pushes its result.
+	// r8 holds the leaves pointer, it is a scratch register in both calling conventions.
+	std::vector<unsigned char> CodeCache::emit(const std::vector<InstructionDataType>& shape) {
+		std::vector<unsigned char> code;
+		auto bytes = [&](std::initializer_list<unsigned char> list) {
+			code.insert(code.end(), list);
+		};
+		auto pop_args = [&](JitOp op) {
+			if (op == JIT_NOT) {
+				bytes({ 0x58 }); // pop rax
+			} else {
+				bytes({ 0x59, 0x58 }); // pop rcx, pop rax
+			}
+		};
+		auto bool_result = [&](unsigned char setcc) {
+			bytes({ 0x0F, setcc, 0xC0 }); // setcc al
+			bytes({ 0x0F, 0xB6, 0xC0 }); // movzx eax, al
+		};
+#ifdef _WIN32
+		bytes({ 0x49, 0x89, 0xC8 }); // mov r8, rcx
+#else
+		bytes({ 0x49, 0x89, 0xF8 }); // mov r8, rdi
+#endif
+		// arguments are emitted before the instruction that uses them
+		struct Pending {
+			JitOp op;
+			ProgramCounterType remaining;
+		};
+		std::vector<Pending> pending;
+		Int32Type leaf_i = 0;
+		auto finish_arg = [&]() {
+			while (!pending.empty() && --pending.back().remaining == 0) {
+				JitOp op = pending.back().op;
+				pending.pop_back();
+				pop_args(op);
+				switch (op) {
+					case JIT_ADD: bytes({ 0x01, 0xC8 }); break; // add eax, ecx
+					case JIT_SUB: bytes({ 0x29, 0xC8 }); break; // sub eax, ecx
+					case JIT_MUL: bytes({ 0x0F, 0xAF, 0xC1 }); break; // imul eax, ecx
+					case JIT_CMP: bytes({ 0x39, 0xC8 }); bool_result(0x94); break; // cmp eax, ecx; sete
+					case JIT_LT: bytes({ 0x39, 0xC8 }); bool_result(0x9C); break; // setl
+					case JIT_GT: bytes({ 0x39, 0xC8 }); bool_result(0x9F); break; // setg
+					case JIT_AND:
+					case JIT_OR:
+					case JIT_XOR:
+						bytes({ 0x85, 0xC0, 0x0F, 0x95, 0xC0 }); // test eax, eax; setne al
+						bytes({ 0x85, 0xC9, 0x0F, 0x95, 0xC1 }); // test ecx, ecx; setne cl
+						if (op == JIT_AND) bytes({ 0x20, 0xC8 }); // and al, cl
+						if (op == JIT_OR) bytes({ 0x08, 0xC8 }); // or al, cl
+						if (op == JIT_XOR) bytes({ 0x30, 0xC8 }); // xor al, cl
+						bytes({ 0x0F, 0xB6, 0xC0 }); // movzx eax, al
+						break;
+					case JIT_NOT: bytes({ 0x85, 0xC0 }); bool_result(0x94); break; // test eax, eax; sete
+					default: throw std::runtime_error("Unsupported instruction");
+				}
+				bytes({ 0x50 }); // push rax
+			}
+		};
+		for (InstructionDataType index : shape) {
+			if (index == LEAF) {
+				Int32Type disp = leaf_i++ * sizeof(Int32Type);
+				bytes({ 0x41, 0x8B, 0x80 }); // mov eax, [r8 + disp32]
+				for (int byte_i = 0; byte_i < 4; byte_i++) {
+					code.push_back((disp >> (byte_i * 8)) & 0xFF);
+				}
+				bytes({ 0x50 }); // push rax
+				finish_arg();
+			} else {
+				JitOp op = get_op(index);
+				if (op == JIT_NONE) {
+					throw std::runtime_error("Unsupported instruction: " + get_instruction_str(index));
+				}
+				pending.push_back({ op, op == JIT_NOT ? 1u : 2u });
+			}
+		}
+		if (!pending.empty()) {
+			throw std::runtime_error("Incomplete shape");
+		}
+		bytes({ 0x58, 0xC3 }); // pop rax, ret
+		return code;
+	}
+
+#ifdef _WIN32
+
+	CodeCache::CodeBuffer::CodeBuffer(const std::vector<unsigned char>& code) : size(code.size()) {
+		memory = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (!memory) {
+			throw std::runtime_error("Cannot allocate code memory");
+		}
+		std::memcpy(memory, code.data(), size);
+		DWORD old_protect;
+		if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &old_protect)) {
+			VirtualFree(memory, 0, MEM_RELEASE);
+			throw std::runtime_error("Cannot make code memory executable");
+		}
+		FlushInstructionCache(GetCurrentProcess(), memory, size);
+	}
+
+	CodeCache::CodeBuffer::~CodeBuffer() {
+		VirtualFree(memory, 0, MEM_RELEASE);
+	}
+
+#else
+
+	CodeCache::CodeBuffer::CodeBuffer(const std::vector<unsigned char>& code) : size(code.size()) {
+		memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory == MAP_FAILED) {
+			memory = nullptr;
+			throw std::runtime_error("Cannot allocate code memory");
+		}
+		std::memcpy(memory, code.data(), size);
+		if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+			munmap(memory, size);
+			throw std::runtime_error("Cannot make code memory executable");
+		}
+	}
+
+	CodeCache::CodeBuffer::~CodeBuffer() {
+		munmap(memory, size);
+	}
+
+#endif
+
+	CompiledFunc CodeCache::CodeBuffer::get_func() const {
+		return reinterpret_cast<CompiledFunc>(memory);
+	}
+
+}
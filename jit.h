@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "token.h"
+
+// Compiles pure int32 arithmetic subtrees to x86-64 machine code.
+// The shape of a subtree is its instructions in prefix order with every leaf replaced by LEAF,
+// code compiled for a shape takes the leaf values of any subtree of that shape.
+// Results are the same as those of the Token functions, on other architectures nothing is compiled.
+namespace jit {
+
+	typedef Int32Type (*CompiledFunc)(const Int32Type* leaves);
+	const InstructionDataType LEAF = -1;
+
+	bool is_supported_instruction(InstructionDataType index);
+
+	class CodeCache {
+	public:
+		// shapes are compiled once they were seen this many times, so shapes of
+		// one-off subtrees do not fill the cache
+		ProgramCounterType hot_count = 2;
+		// nullptr while the shape is not hot yet
+		CompiledFunc get(const std::vector<InstructionDataType>& shape);
+		ProgramCounterType get_compiled_count() const;
+
+	private:
+		// executable pages holding the code of one shape
+		class CodeBuffer {
+		public:
+			CodeBuffer(const std::vector<unsigned char>& code);
+			~CodeBuffer();
+			CodeBuffer(const CodeBuffer&) = delete;
+			CodeBuffer& operator=(const CodeBuffer&) = delete;
+			CompiledFunc get_func() const;
+
+		private:
+			void* memory = nullptr;
+			ProgramCounterType size = 0;
+		};
+		struct ShapeHash {
+			std::size_t operator()(const std::vector<InstructionDataType>& shape) const;
+		};
+		struct Entry {
+			ProgramCounterType hits = 0;
+			std::shared_ptr<CodeBuffer> code;
+		};
+		std::unordered_map<std::vector<InstructionDataType>, Entry, ShapeHash> entries;
+		ProgramCounterType compiled_count = 0;
+		static std::vector<unsigned char> emit(const std::vector<InstructionDataType>& shape);
+	};
+
+}
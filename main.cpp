@@ -28,6 +28,7 @@ void execute_program_normal(std::string path) {
 		std::string program_text = utils::file_to_str(path);
 		Interpreter program(program_text);
 		program.print_buffer_enabled = true;
+		program.input.set_source(InputBuffer::stream_source(std::cin));
 		auto t1 = std::chrono::high_resolution_clock::now();
 		std::vector<Token> results = program.execute();
 		auto t2 = std::chrono::high_resolution_clock::now();
@@ -40,12 +41,35 @@ void execute_program_normal(std::string path) {
 	}
 }
 
+// Writes a timeline of the execution that chrome://tracing or ui.perfetto.dev can open.
+void execute_program_trace(std::string path, std::string trace_path) {
+	try {
+		std::string program_text = utils::file_to_str(path);
+		Interpreter program(program_text);
+		program.print_buffer_enabled = true;
+		program.input.set_source(InputBuffer::stream_source(std::cin));
+		program.tracer = std::make_shared<trace::Recorder>();
+		try {
+			program.execute();
+		} catch (...) {
+			program.tracer->save(trace_path);
+			throw;
+		}
+		program.tracer->save(trace_path);
+		std::cout << "Results: ";
+		program.print_tokens(program.tokens, false);
+	} catch (std::exception exc) {
+		throw std::runtime_error(path + ": " + exc.what());
+	}
+}
+
 int main() {
 	try {
 
 		//execute_program_debug("program.bvmi");
 		//execute_program_debug("tests/label.bvmi");
 		//execute_program_normal("program.bvmi");
+		//execute_program_trace("program.bvmi", "trace.json");
 		test::run_tests();
 
 	} catch (std::string msg) {
@@ -57,27 +81,15 @@ int main() {
 	// TODO: function call macro
 	// TODO: def instruction, for defining macros
 	// TODO: builtin macros (which are part of the intermediate language itself)
-	// TODO: nodes disappear if they are not connected to anything
 	// TODO: move and swap instructions, for moving and swapping subtrees
-	// TODO: next and prev instructions, move pointer to the next and previous subtree
-	// up, down to go between the tree levels
-	// hshift and vshift to multiple steps
-	// TODO: block instruction, separates program into blocks, blocks have
 	// TODO: wait instruction, like get but executes only if its target is a number
-	// TODO: math functions take lists as arguments (and possibly other functions?)
-	// TODO: adding numbers to lists and lists to numbers
 	// TODO: make Token.str debug-only
 	// TODO: replace command string tokens in the code with enum values
 	// TODO: do not parse code every time, keep parsed nodes around if they are not touched by modifying instructiions
 	// TODO: shift pointers from pointer list, instead of scanning the whole token list
 	// TODO: place program counter at the leftmost change position at new iteration
-	// TODO: getsize instruction, returns size of the subtree
 	// TODO: get instruction, returns two numbers: first number signifies whether token is an instruction or a number,
 	// second number is num_value if it is a number, or instruction index if it is an instruction
-	// TODO: file instruction that reads file and converts it into a list of chars
-	// TODO: malloc, free and read instructions for working with heap memory
-	// TODO: getaddr instruction, get absolute address of the current node
-	// TODO: modifying instructions can only address stuff inside its list (block instruction?)
 	// TODO: fractal lists?
 	// TODO: parallel computation of lists
 	// TODO: CUDA version
@@ -0,0 +1,63 @@
+#include "native.h"
+#include <stdexcept>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+static std::vector<NativeFunction>& native_list() {
+	static std::vector<NativeFunction> function_list;
+	return function_list;
+}
+
+void register_native(std::string name, ProgramCounterType arg_count, NativeFunction function) {
+	try {
+		if (!function) {
+			throw std::runtime_error("Empty function");
+		}
+		InstructionDataType index = register_instruction(name, arg_count);
+		std::vector<NativeFunction>& function_list = native_list();
+		function_list.resize(index - INSTRUCTION_LIST.size() + 1);
+		function_list.back() = function;
+	} catch (std::exception exc) {
+		throw std::runtime_error(__FUNCTION__": " + name + ": " + std::string(exc.what()));
+	}
+}
+
+const NativeFunction* get_native(InstructionDataType index) {
+	if (index < (InstructionDataType)INSTRUCTION_LIST.size()) {
+		return nullptr;
+	}
+	std::vector<NativeFunction>& function_list = native_list();
+	ProgramCounterType native_index = index - INSTRUCTION_LIST.size();
+	if (native_index >= function_list.size() || !function_list[native_index]) {
+		return nullptr;
+	}
+	return &function_list[native_index];
+}
+
+// The library stays loaded until the program exits, since registered functions point into it.
+void load_native_library(std::string path) {
+	typedef void (*EntryPoint)(NativeRegisterFunc register_func);
+	const char* entry_point_name = "bvm_register_natives";
+#ifdef _WIN32
+	HMODULE library = LoadLibraryA(path.c_str());
+	if (!library) {
+		throw std::runtime_error("Cannot load library: " + path);
+	}
+	EntryPoint entry_point = reinterpret_cast<EntryPoint>(GetProcAddress(library, entry_point_name));
+#else
+	void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!library) {
+		throw std::runtime_error("Cannot load library: " + path + ": " + dlerror());
+	}
+	EntryPoint entry_point = reinterpret_cast<EntryPoint>(dlsym(library, entry_point_name));
+#endif
+	if (!entry_point) {
+		throw std::runtime_error("Library has no " + std::string(entry_point_name) + ": " + path);
+	}
+	entry_point(register_native);
+}
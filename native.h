@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "token.h"
+
+// Argument of a native instruction: a number or the elements of a list of numbers.
+struct NativeArg {
+	bool is_list = false;
+	Token number;
+	std::vector<Token> elements;
+};
+
+// Host function executed as one instruction, returns the tokens that replace the instruction with its arguments.
+typedef std::function<std::vector<Token>(const std::vector<NativeArg>& args)> NativeFunction;
+typedef void (*NativeRegisterFunc)(std::string name, ProgramCounterType arg_count, NativeFunction function);
+
+// Natives have to be registered before the programs that use them are compiled.
+void register_native(std::string name, ProgramCounterType arg_count, NativeFunction function);
+// nullptr if the instruction is not a native
+const NativeFunction* get_native(InstructionDataType index);
+// Loads a shared library and calls its exported
+// extern "C" void bvm_register_natives(NativeRegisterFunc register_func)
+void load_native_library(std::string path);
@@ -0,0 +1,367 @@
+#include "object.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include "instruction.h"
+
+TokenObject::TokenObject() : id([]() {
+	static std::atomic<utils::LongNumberType> next_id = 0;
+	return next_id++;
+}()) { }
+
+#define PACKED_ARRAY_CASE(TP1, TP2, FUNC) \
+	case TP1: \
+		{ \
+			typedef TP2 elem_t; \
+			FUNC \
+		} \
+		break;
+
+#define PACKED_ARRAY_SWITCH(FUNC) \
+	switch (elem_type) { \
+		PACKED_ARRAY_CASE(type_int32, Int32Type, FUNC) \
+		PACKED_ARRAY_CASE(type_int64, Int64Type, FUNC) \
+		PACKED_ARRAY_CASE(type_uint32, Uint32Type, FUNC) \
+		PACKED_ARRAY_CASE(type_uint64, Uint64Type, FUNC) \
+		PACKED_ARRAY_CASE(type_float, FloatDataType, FUNC) \
+		PACKED_ARRAY_CASE(type_double, DoubleDataType, FUNC) \
+		default: \
+			throw std::runtime_error("Unknown array element type: " + std::to_string(elem_type)); \
+	}
+
+PackedArray::PackedArray(token_type elem_type) : elem_type(elem_type) {
+	if (!is_elem_type(elem_type)) {
+		throw std::runtime_error("Unknown array element type: " + std::to_string(elem_type));
+	}
+}
+
+bool PackedArray::is_elem_type(token_type type) {
+	switch (type) {
+		case type_int32:
+		case type_int64:
+		case type_uint32:
+		case type_uint64:
+		case type_float:
+		case type_double:
+			return true;
+		default:
+			return false;
+	}
+}
+
+ProgramCounterType PackedArray::size() const {
+	return bytes->size() / elem_size();
+}
+
+Token PackedArray::get(ProgramCounterType index) const {
+	Token result;
+	result.type = elem_type;
+	PACKED_ARRAY_SWITCH(
+		elem_t value;
+		std::memcpy(&value, &(*bytes)[index * sizeof(elem_t)], sizeof(elem_t));
+		result.set_data<elem_t>(value);
+	)
+	result.str = result.to_string();
+	return result;
+}
+
+void PackedArray::set(ProgramCounterType index, Token value) {
+	write(index, value);
+}
+
+void PackedArray::insert(ProgramCounterType index, Token value) {
+	std::vector<unsigned char>& buffer = mutable_bytes();
+	buffer.insert(buffer.begin() + index * elem_size(), elem_size(), 0);
+	write(index, value);
+}
+
+void PackedArray::erase(ProgramCounterType index) {
+	std::vector<unsigned char>& buffer = mutable_bytes();
+	auto pos = buffer.begin() + index * elem_size();
+	buffer.erase(pos, pos + elem_size());
+}
+
+void PackedArray::resize(ProgramCounterType size) {
+	mutable_bytes().resize(size * elem_size());
+}
+
+void* PackedArray::data() {
+	return mutable_bytes().data();
+}
+
+const void* PackedArray::data() const {
+	return bytes->data();
+}
+
+std::string PackedArray::name() const {
+	return "array";
+}
+
+std::shared_ptr<TokenObject> PackedArray::clone() const {
+	std::shared_ptr<PackedArray> result = std::make_shared<PackedArray>(elem_type);
+	result->bytes = bytes;
+	return result;
+}
+
+bool PackedArray::equals(const TokenObject& other) const {
+	const PackedArray* other_array = dynamic_cast<const PackedArray*>(&other);
+	return
+		other_array && other_array->elem_type == elem_type
+		&& (other_array->bytes == bytes || *other_array->bytes == *bytes)
+	;
+}
+
+std::string PackedArray::to_string() const {
+	std::string str = name() + "<" + type_to_string(elem_type) + ">{";
+	for (ProgramCounterType i = 0; i < size(); i++) {
+		if (i > 0) {
+			str += ", ";
+		}
+		str += get(i).to_string();
+	}
+	str += "}";
+	return str;
+}
+
+ProgramCounterType PackedArray::elem_size() const {
+	PACKED_ARRAY_SWITCH(
+		return sizeof(elem_t);
+	)
+}
+
+// Detaches the buffer from clones before it is written.
+std::vector<unsigned char>& PackedArray::mutable_bytes() {
+	if (bytes.use_count() > 1) {
+		bytes = std::make_shared<std::vector<unsigned char>>(*bytes);
+	}
+	return *bytes;
+}
+
+void PackedArray::write(ProgramCounterType index, Token value) {
+	value.cast(elem_type);
+	PACKED_ARRAY_SWITCH(
+		elem_t data = value.get_data<elem_t>();
+		std::memcpy(&mutable_bytes()[index * sizeof(elem_t)], &data, sizeof(elem_t));
+	)
+}
+
+ProgramCounterType HashMap::size() const {
+	return count;
+}
+
+const Token* HashMap::get(const Token& key) const {
+	ProgramCounterType slot_i = find_slot(key);
+	return slot_i != slots.size() && slots[slot_i].state == SLOT_FULL ? &slots[slot_i].value : nullptr;
+}
+
+void HashMap::put(Token key, Token value) {
+	// keeping at least a quarter of slots empty so probing always terminates quickly
+	if ((used_count + 1) * 4 > slots.size() * 3) {
+		rehash(std::max<ProgramCounterType>(8, count * 4));
+	}
+	ProgramCounterType slot_i = find_slot(key);
+	Slot& slot = slots[slot_i];
+	if (slot.state != SLOT_FULL) {
+		slot.state = SLOT_FULL;
+		slot.key = key;
+		count++;
+		used_count++;
+	}
+	slot.value = value;
+}
+
+bool HashMap::erase(const Token& key) {
+	ProgramCounterType slot_i = find_slot(key);
+	if (slot_i == slots.size() || slots[slot_i].state != SLOT_FULL) {
+		return false;
+	}
+	slots[slot_i].state = SLOT_DELETED;
+	slots[slot_i].key = Token();
+	slots[slot_i].value = Token();
+	count--;
+	return true;
+}
+
+std::string HashMap::name() const {
+	return "map";
+}
+
+std::shared_ptr<TokenObject> HashMap::clone() const {
+	std::shared_ptr<HashMap> result = std::make_shared<HashMap>();
+	result->slots = slots;
+	result->count = count;
+	result->used_count = used_count;
+	return result;
+}
+
+bool HashMap::equals(const TokenObject& other) const {
+	const HashMap* other_map = dynamic_cast<const HashMap*>(&other);
+	if (!other_map || other_map->count != count) {
+		return false;
+	}
+	for (const Slot& slot : slots) {
+		if (slot.state == SLOT_FULL) {
+			const Token* other_value = other_map->get(slot.key);
+			if (!other_value || !(*other_value == slot.value)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+std::string HashMap::to_string() const {
+	std::string str = name() + "{";
+	bool first = true;
+	for (const Slot& slot : slots) {
+		if (slot.state == SLOT_FULL) {
+			if (!first) {
+				str += ", ";
+			}
+			str += slot.key.to_string() + ": " + slot.value.to_string();
+			first = false;
+		}
+	}
+	str += "}";
+	return str;
+}
+
+// Returns the slot holding the key, or the first free slot on its probe sequence,
+// or slots.size() if the table is empty.
+ProgramCounterType HashMap::find_slot(const Token& key) const {
+	if (slots.empty()) {
+		return slots.size();
+	}
+	ProgramCounterType mask = slots.size() - 1;
+	ProgramCounterType free_slot = slots.size();
+	for (ProgramCounterType slot_i = key.hash() & mask; ; slot_i = (slot_i + 1) & mask) {
+		const Slot& slot = slots[slot_i];
+		if (slot.state == SLOT_EMPTY) {
+			return free_slot != slots.size() ? free_slot : slot_i;
+		} else if (slot.state == SLOT_DELETED) {
+			if (free_slot == slots.size()) {
+				free_slot = slot_i;
+			}
+		} else if (slot.key == key) {
+			return slot_i;
+		}
+	}
+}
+
+void HashMap::rehash(ProgramCounterType capacity) {
+	ProgramCounterType new_capacity = 1;
+	while (new_capacity < capacity) {
+		new_capacity *= 2;
+	}
+	std::vector<Slot> old_slots = std::move(slots);
+	slots = std::vector<Slot>(new_capacity);
+	count = 0;
+	used_count = 0;
+	for (Slot& slot : old_slots) {
+		if (slot.state == SLOT_FULL) {
+			put(slot.key, slot.value);
+		}
+	}
+}
+
+SharedTree::SharedTree(std::vector<Token> tokens) : storage(intern(std::move(tokens))) { }
+
+SharedTree::SharedTree(Storage storage) : storage(storage) { }
+
+// Numbers, pointers, list headers and ends, anything else can change in place or execute.
+bool SharedTree::is_tree_token(Token& token) {
+	return token.is_num_or_ptr() || (token.node_flags & (NODE_CONTAINER | NODE_ORDERED | NODE_SEQ)) == (NODE_CONTAINER | NODE_ORDERED) || (token.node_flags & NODE_END);
+}
+
+const std::vector<Token>& SharedTree::get_tokens() const {
+	return *storage;
+}
+
+std::string SharedTree::name() const {
+	return "tree";
+}
+
+std::shared_ptr<TokenObject> SharedTree::clone() const {
+	return std::shared_ptr<SharedTree>(new SharedTree(storage));
+}
+
+bool SharedTree::equals(const TokenObject& other) const {
+	// equal trees that are alive at the same time always share storage
+	const SharedTree* other_tree = dynamic_cast<const SharedTree*>(&other);
+	return other_tree && other_tree->storage == storage;
+}
+
+std::string SharedTree::to_string() const {
+	std::string str = name() + "{";
+	for (ProgramCounterType i = 0; i < storage->size(); i++) {
+		if (i > 0) {
+			str += " ";
+		}
+		str += (*storage)[i].to_string();
+	}
+	str += "}";
+	return str;
+}
+
+// Live trees by hash. It is never destroyed, as trees held by static objects can be released after
+// the end of main.
+struct InternTable {
+	std::unordered_map<utils::LongNumberType, std::vector<std::weak_ptr<const std::vector<Token>>>> buckets;
+	std::mutex mutex;
+};
+static InternTable& intern_table = *new InternTable();
+
+// Returns the storage of an equal live tree if there is one.
+// Interpreters of different blocks can intern at the same time, so the table is locked.
+// Storage removes its bucket once no other tree has the same hash, so the table only holds live trees.
+SharedTree::Storage SharedTree::intern(std::vector<Token> tokens) {
+	utils::LongNumberType hash = tokens.size();
+	for (const Token& token : tokens) {
+		hash = utils::hash_mix(hash ^ token.hash());
+	}
+	// locked storages are released after the lock, their deleter takes it too
+	std::vector<Storage> locked;
+	std::lock_guard<std::mutex> lock(intern_table.mutex);
+	std::vector<std::weak_ptr<const std::vector<Token>>>& bucket = intern_table.buckets[hash];
+	Storage result;
+	for (ProgramCounterType i = 0; i < bucket.size(); ) {
+		Storage existing = bucket[i].lock();
+		if (!existing) {
+			bucket[i] = bucket.back();
+			bucket.pop_back();
+			continue;
+		}
+		if (!result && *existing == tokens) {
+			result = existing;
+		}
+		locked.push_back(existing);
+		i++;
+	}
+	if (!result) {
+		result = Storage(new std::vector<Token>(std::move(tokens)), [hash](const std::vector<Token>* storage) {
+			delete storage;
+			release(hash);
+		});
+		bucket.push_back(result);
+	}
+	return result;
+}
+
+void SharedTree::release(utils::LongNumberType hash) {
+	std::lock_guard<std::mutex> lock(intern_table.mutex);
+	auto it = intern_table.buckets.find(hash);
+	if (it == intern_table.buckets.end()) {
+		return;
+	}
+	std::erase_if(it->second, [](const std::weak_ptr<const std::vector<Token>>& entry) {
+		return entry.expired();
+	});
+	if (it->second.empty()) {
+		intern_table.buckets.erase(it);
+	}
+}
+
+ProgramCounterType SharedTree::get_intern_table_size() {
+	std::lock_guard<std::mutex> lock(intern_table.mutex);
+	return intern_table.buckets.size();
+}
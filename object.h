@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "token.h"
+
+// Value owned by a single type_object token.
+// Objects are cloned when their token is copied and keep their identity when it is moved.
+class TokenObject {
+public:
+	const utils::LongNumberType id;
+	TokenObject();
+	virtual ~TokenObject() { }
+	virtual std::string name() const = 0;
+	virtual std::shared_ptr<TokenObject> clone() const = 0;
+	virtual bool equals(const TokenObject& other) const = 0;
+	virtual std::string to_string() const = 0;
+};
+
+// Contiguous buffer of numbers of one type, occupies one token regardless of its size.
+// Clones share the buffer until one of them is written.
+class PackedArray : public TokenObject {
+public:
+	const token_type elem_type;
+	PackedArray(token_type elem_type);
+	static bool is_elem_type(token_type type);
+	ProgramCounterType size() const;
+	Token get(ProgramCounterType index) const;
+	void set(ProgramCounterType index, Token value);
+	void insert(ProgramCounterType index, Token value);
+	void erase(ProgramCounterType index);
+	void resize(ProgramCounterType size);
+	void* data();
+	const void* data() const;
+	std::string name() const override;
+	std::shared_ptr<TokenObject> clone() const override;
+	bool equals(const TokenObject& other) const override;
+	std::string to_string() const override;
+
+private:
+	std::shared_ptr<std::vector<unsigned char>> bytes = std::make_shared<std::vector<unsigned char>>();
+	ProgramCounterType elem_size() const;
+	std::vector<unsigned char>& mutable_bytes();
+	void write(ProgramCounterType index, Token value);
+
+};
+
+// Open addressing hash table from numbers to numbers with linear probing.
+// Keys are equal when both their type and value are equal.
+class HashMap : public TokenObject {
+public:
+	ProgramCounterType size() const;
+	const Token* get(const Token& key) const;
+	void put(Token key, Token value);
+	bool erase(const Token& key);
+	std::string name() const override;
+	std::shared_ptr<TokenObject> clone() const override;
+	bool equals(const TokenObject& other) const override;
+	std::string to_string() const override;
+
+private:
+	enum SlotState {
+		SLOT_EMPTY,
+		SLOT_FULL,
+		SLOT_DELETED,
+	};
+	struct Slot {
+		SlotState state = SLOT_EMPTY;
+		Token key;
+		Token value;
+	};
+	std::vector<Slot> slots;
+	ProgramCounterType count = 0;
+	ProgramCounterType used_count = 0;
+	ProgramCounterType find_slot(const Token& key) const;
+	void rehash(ProgramCounterType capacity);
+
+};
+
+// Immutable subtree of numbers, pointers and lists.
+// Equal subtrees share one copy of their tokens, so copying a tree token is constant time
+// and comparing two trees is a pointer compare. The tokens are materialized again by unpack.
+class SharedTree : public TokenObject {
+public:
+	SharedTree(std::vector<Token> tokens);
+	static bool is_tree_token(Token& token);
+	const std::vector<Token>& get_tokens() const;
+	std::string name() const override;
+	std::shared_ptr<TokenObject> clone() const override;
+	bool equals(const TokenObject& other) const override;
+	std::string to_string() const override;
+	// number of distinct live trees
+	static ProgramCounterType get_intern_table_size();
+
+private:
+	typedef std::shared_ptr<const std::vector<Token>> Storage;
+	Storage storage;
+	SharedTree(Storage storage);
+	static Storage intern(std::vector<Token> tokens);
+	static void release(utils::LongNumberType hash);
+
+};
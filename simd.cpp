@@ -0,0 +1,587 @@
+#include "simd.h"
+#include <cmath>
+#include <map>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
+
+namespace simd {
+
+	struct OpAdd { template <typename T> static T apply(T a, T b) { return a + b; } };
+	struct OpSub { template <typename T> static T apply(T a, T b) { return a - b; } };
+	struct OpMul { template <typename T> static T apply(T a, T b) { return a * b; } };
+	struct OpDiv { template <typename T> static T apply(T a, T b) { return a / b; } };
+	// comparisons and logic give 1 or 0 as Int32Type, like the Token functions
+	struct OpCmp { template <typename T> static bool apply(T a, T b) { return a == b; } };
+	struct OpLt { template <typename T> static bool apply(T a, T b) { return a < b; } };
+	struct OpGt { template <typename T> static bool apply(T a, T b) { return a > b; } };
+	struct OpAnd { template <typename T> static bool apply(T a, T b) { return a && b; } };
+	struct OpOr { template <typename T> static bool apply(T a, T b) { return a || b; } };
+	struct OpFloor { template <typename T> static T apply(T a) { return std::floor(a); } };
+	struct OpCeil { template <typename T> static T apply(T a) { return std::ceil(a); } };
+
+	template <typename T, typename Op>
+	void scalar_binary(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count) {
+		const T* x = (const T*)a;
+		const T* y = (const T*)b;
+		T* z = (T*)out;
+		for (ProgramCounterType i = 0; i < count; i++) {
+			z[i] = Op::apply(x[a_scalar ? 0 : i], y[b_scalar ? 0 : i]);
+		}
+	}
+
+	template <typename T, typename Op>
+	void scalar_compare(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count) {
+		const T* x = (const T*)a;
+		const T* y = (const T*)b;
+		Int32Type* z = (Int32Type*)out;
+		for (ProgramCounterType i = 0; i < count; i++) {
+			z[i] = Op::apply(x[a_scalar ? 0 : i], y[b_scalar ? 0 : i]) ? 1 : 0;
+		}
+	}
+
+	template <typename T, typename Op>
+	void scalar_unary(const void* a, void* out, ProgramCounterType count) {
+		const T* x = (const T*)a;
+		T* z = (T*)out;
+		for (ProgramCounterType i = 0; i < count; i++) {
+			z[i] = Op::apply(x[i]);
+		}
+	}
+
+	template <typename T>
+	void scalar_sum(const void* a, [[maybe_unused]] const void* b, ProgramCounterType count, void* out) {
+		const T* x = (const T*)a;
+		T result = count > 0 ? x[0] : T(0);
+		for (ProgramCounterType i = 1; i < count; i++) {
+			result = result + x[i];
+		}
+		*(T*)out = result;
+	}
+
+	template <typename T>
+	void scalar_min(const void* a, [[maybe_unused]] const void* b, ProgramCounterType count, void* out) {
+		const T* x = (const T*)a;
+		T result = x[0];
+		for (ProgramCounterType i = 1; i < count; i++) {
+			if (x[i] < result) {
+				result = x[i];
+			}
+		}
+		*(T*)out = result;
+	}
+
+	template <typename T>
+	void scalar_max(const void* a, [[maybe_unused]] const void* b, ProgramCounterType count, void* out) {
+		const T* x = (const T*)a;
+		T result = x[0];
+		for (ProgramCounterType i = 1; i < count; i++) {
+			if (x[i] > result) {
+				result = x[i];
+			}
+		}
+		*(T*)out = result;
+	}
+
+	template <typename T>
+	void scalar_dot(const void* a, const void* b, ProgramCounterType count, void* out) {
+		const T* x = (const T*)a;
+		const T* y = (const T*)b;
+		T result = count > 0 ? T(x[0] * y[0]) : T(0);
+		for (ProgramCounterType i = 1; i < count; i++) {
+			result = result + T(x[i] * y[i]);
+		}
+		*(T*)out = result;
+	}
+
+#ifdef SIMD_X86
+
+	// Vector traits: T is the element type, V the register type.
+	// The same kernel template is instantiated for SSE2 and AVX2 traits.
+	struct Sse2Float {
+		typedef FloatDataType T; typedef __m128 V; static const int width = 4;
+		static V load(const T* p) { return _mm_loadu_ps(p); }
+		static V set1(T v) { return _mm_set1_ps(v); }
+		static void store(T* p, V v) { _mm_storeu_ps(p, v); }
+		static V add(V a, V b) { return _mm_add_ps(a, b); }
+		static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+		static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+		static V div(V a, V b) { return _mm_div_ps(a, b); }
+		static __m128i eq(V a, V b) { return _mm_castps_si128(_mm_cmpeq_ps(a, b)); }
+		static __m128i lt(V a, V b) { return _mm_castps_si128(_mm_cmplt_ps(a, b)); }
+		static __m128i gt(V a, V b) { return _mm_castps_si128(_mm_cmpgt_ps(a, b)); }
+		static void store_mask(Int32Type* p, __m128i m) { _mm_storeu_si128((__m128i*)p, _mm_and_si128(m, _mm_set1_epi32(1))); }
+	};
+	struct Sse2Double {
+		typedef DoubleDataType T; typedef __m128d V; static const int width = 2;
+		static V load(const T* p) { return _mm_loadu_pd(p); }
+		static V set1(T v) { return _mm_set1_pd(v); }
+		static void store(T* p, V v) { _mm_storeu_pd(p, v); }
+		static V add(V a, V b) { return _mm_add_pd(a, b); }
+		static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+		static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+		static V div(V a, V b) { return _mm_div_pd(a, b); }
+	};
+	struct Sse2Int32 {
+		typedef Int32Type T; typedef __m128i V; static const int width = 4;
+		static V load(const T* p) { return _mm_loadu_si128((const __m128i*)p); }
+		static V set1(T v) { return _mm_set1_epi32(v); }
+		static void store(T* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+		static V add(V a, V b) { return _mm_add_epi32(a, b); }
+		static V sub(V a, V b) { return _mm_sub_epi32(a, b); }
+		static V eq(V a, V b) { return _mm_cmpeq_epi32(a, b); }
+		static V lt(V a, V b) { return _mm_cmplt_epi32(a, b); }
+		static V gt(V a, V b) { return _mm_cmpgt_epi32(a, b); }
+		static V both_nonzero(V a, V b) {
+			V zero = _mm_setzero_si128();
+			return _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(a, zero), _mm_cmpeq_epi32(b, zero)), _mm_set1_epi32(-1));
+		}
+		static V any_nonzero(V a, V b) {
+			V zero = _mm_setzero_si128();
+			return _mm_andnot_si128(_mm_and_si128(_mm_cmpeq_epi32(a, zero), _mm_cmpeq_epi32(b, zero)), _mm_set1_epi32(-1));
+		}
+		static void store_mask(Int32Type* p, V m) { _mm_storeu_si128((__m128i*)p, _mm_and_si128(m, _mm_set1_epi32(1))); }
+	};
+	struct Sse2Int64 {
+		typedef Int64Type T; typedef __m128i V; static const int width = 2;
+		static V load(const T* p) { return _mm_loadu_si128((const __m128i*)p); }
+		static V set1(T v) { return _mm_set1_epi64x(v); }
+		static void store(T* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+		static V add(V a, V b) { return _mm_add_epi64(a, b); }
+		static V sub(V a, V b) { return _mm_sub_epi64(a, b); }
+	};
+	struct Avx2Float {
+		typedef FloatDataType T; typedef __m256 V; static const int width = 8;
+		SIMD_TARGET_AVX2 static V load(const T* p) { return _mm256_loadu_ps(p); }
+		SIMD_TARGET_AVX2 static V set1(T v) { return _mm256_set1_ps(v); }
+		SIMD_TARGET_AVX2 static void store(T* p, V v) { _mm256_storeu_ps(p, v); }
+		SIMD_TARGET_AVX2 static V add(V a, V b) { return _mm256_add_ps(a, b); }
+		SIMD_TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+		SIMD_TARGET_AVX2 static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+		SIMD_TARGET_AVX2 static V div(V a, V b) { return _mm256_div_ps(a, b); }
+		SIMD_TARGET_AVX2 static V floor(V a) { return _mm256_floor_ps(a); }
+		SIMD_TARGET_AVX2 static V ceil(V a) { return _mm256_ceil_ps(a); }
+		SIMD_TARGET_AVX2 static __m256i eq(V a, V b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_EQ_OQ)); }
+		SIMD_TARGET_AVX2 static __m256i lt(V a, V b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+		SIMD_TARGET_AVX2 static __m256i gt(V a, V b) { return _mm256_castps_si256(_mm256_cmp_ps(a, b, _CMP_GT_OQ)); }
+		SIMD_TARGET_AVX2 static void store_mask(Int32Type* p, __m256i m) {
+			_mm256_storeu_si256((__m256i*)p, _mm256_and_si256(m, _mm256_set1_epi32(1)));
+		}
+	};
+	struct Avx2Double {
+		typedef DoubleDataType T; typedef __m256d V; static const int width = 4;
+		SIMD_TARGET_AVX2 static V load(const T* p) { return _mm256_loadu_pd(p); }
+		SIMD_TARGET_AVX2 static V set1(T v) { return _mm256_set1_pd(v); }
+		SIMD_TARGET_AVX2 static void store(T* p, V v) { _mm256_storeu_pd(p, v); }
+		SIMD_TARGET_AVX2 static V add(V a, V b) { return _mm256_add_pd(a, b); }
+		SIMD_TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+		SIMD_TARGET_AVX2 static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+		SIMD_TARGET_AVX2 static V div(V a, V b) { return _mm256_div_pd(a, b); }
+		SIMD_TARGET_AVX2 static V floor(V a) { return _mm256_floor_pd(a); }
+		SIMD_TARGET_AVX2 static V ceil(V a) { return _mm256_ceil_pd(a); }
+	};
+	struct Avx2Int32 {
+		typedef Int32Type T; typedef __m256i V; static const int width = 8;
+		SIMD_TARGET_AVX2 static V load(const T* p) { return _mm256_loadu_si256((const __m256i*)p); }
+		SIMD_TARGET_AVX2 static V set1(T v) { return _mm256_set1_epi32(v); }
+		SIMD_TARGET_AVX2 static void store(T* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+		SIMD_TARGET_AVX2 static V add(V a, V b) { return _mm256_add_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V mul(V a, V b) { return _mm256_mullo_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V min(V a, V b) { return _mm256_min_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V max(V a, V b) { return _mm256_max_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V eq(V a, V b) { return _mm256_cmpeq_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V lt(V a, V b) { return _mm256_cmpgt_epi32(b, a); }
+		SIMD_TARGET_AVX2 static V gt(V a, V b) { return _mm256_cmpgt_epi32(a, b); }
+		SIMD_TARGET_AVX2 static V both_nonzero(V a, V b) {
+			V zero = _mm256_setzero_si256();
+			return _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(a, zero), _mm256_cmpeq_epi32(b, zero)), _mm256_set1_epi32(-1));
+		}
+		SIMD_TARGET_AVX2 static V any_nonzero(V a, V b) {
+			V zero = _mm256_setzero_si256();
+			return _mm256_andnot_si256(_mm256_and_si256(_mm256_cmpeq_epi32(a, zero), _mm256_cmpeq_epi32(b, zero)), _mm256_set1_epi32(-1));
+		}
+		SIMD_TARGET_AVX2 static void store_mask(Int32Type* p, V m) {
+			_mm256_storeu_si256((__m256i*)p, _mm256_and_si256(m, _mm256_set1_epi32(1)));
+		}
+	};
+	struct Avx2Int64 {
+		typedef Int64Type T; typedef __m256i V; static const int width = 4;
+		SIMD_TARGET_AVX2 static V load(const T* p) { return _mm256_loadu_si256((const __m256i*)p); }
+		SIMD_TARGET_AVX2 static V set1(T v) { return _mm256_set1_epi64x(v); }
+		SIMD_TARGET_AVX2 static void store(T* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+		SIMD_TARGET_AVX2 static V add(V a, V b) { return _mm256_add_epi64(a, b); }
+		SIMD_TARGET_AVX2 static V sub(V a, V b) { return _mm256_sub_epi64(a, b); }
+	};
+
+	enum VecOp {
+		VEC_ADD,
+		VEC_SUB,
+		VEC_MUL,
+		VEC_DIV,
+		VEC_MIN,
+		VEC_MAX,
+		VEC_CMP,
+		VEC_LT,
+		VEC_GT,
+		VEC_AND,
+		VEC_OR,
+		VEC_FLOOR,
+		VEC_CEIL,
+	};
+
+	// Expanded inside each kernel so the vector code keeps the kernel's target
+	#define SIMD_VEC_APPLY(RESULT, VA, VB) \
+		if constexpr (vec_op == VEC_ADD) { RESULT = Tr::add(VA, VB); } \
+		else if constexpr (vec_op == VEC_SUB) { RESULT = Tr::sub(VA, VB); } \
+		else if constexpr (vec_op == VEC_MUL) { RESULT = Tr::mul(VA, VB); } \
+		else if constexpr (vec_op == VEC_DIV) { RESULT = Tr::div(VA, VB); } \
+		else if constexpr (vec_op == VEC_MIN) { RESULT = Tr::min(VA, VB); } \
+		else { RESULT = Tr::max(VA, VB); }
+
+	// Element-wise kernel body, the tail is handled by the scalar kernel.
+	// Broadcast operands are loaded once with set1.
+	#define SIMD_BINARY_KERNEL_BODY \
+		typedef typename Tr::T T; \
+		if (count == 0) { \
+			return; \
+		} \
+		const T* x = (const T*)a; \
+		const T* y = (const T*)b; \
+		T* z = (T*)out; \
+		typename Tr::V x_const = Tr::set1(x[0]); \
+		typename Tr::V y_const = Tr::set1(y[0]); \
+		ProgramCounterType i = 0; \
+		for (; i + Tr::width <= count; i += Tr::width) { \
+			typename Tr::V va = a_scalar ? x_const : Tr::load(x + i); \
+			typename Tr::V vb = b_scalar ? y_const : Tr::load(y + i); \
+			typename Tr::V vr; \
+			SIMD_VEC_APPLY(vr, va, vb) \
+			Tr::store(z + i, vr); \
+		} \
+		scalar_binary<T, Op>(a_scalar ? a : x + i, a_scalar, b_scalar ? b : y + i, b_scalar, z + i, count - i);
+
+	// Comparisons and logic on 32 bit elements, the lanes of the 1 or 0 results line up with the operand lanes.
+	// Logic is only vectorized for Int32Type, the Token functions cast other operands to it first.
+	#define SIMD_COMPARE_KERNEL_BODY \
+		typedef typename Tr::T T; \
+		if (count == 0) { \
+			return; \
+		} \
+		const T* x = (const T*)a; \
+		const T* y = (const T*)b; \
+		Int32Type* z = (Int32Type*)out; \
+		typename Tr::V x_const = Tr::set1(x[0]); \
+		typename Tr::V y_const = Tr::set1(y[0]); \
+		ProgramCounterType i = 0; \
+		for (; i + Tr::width <= count; i += Tr::width) { \
+			typename Tr::V va = a_scalar ? x_const : Tr::load(x + i); \
+			typename Tr::V vb = b_scalar ? y_const : Tr::load(y + i); \
+			if constexpr (vec_op == VEC_CMP) { Tr::store_mask(z + i, Tr::eq(va, vb)); } \
+			else if constexpr (vec_op == VEC_LT) { Tr::store_mask(z + i, Tr::lt(va, vb)); } \
+			else if constexpr (vec_op == VEC_GT) { Tr::store_mask(z + i, Tr::gt(va, vb)); } \
+			else if constexpr (vec_op == VEC_AND) { Tr::store_mask(z + i, Tr::both_nonzero(va, vb)); } \
+			else { Tr::store_mask(z + i, Tr::any_nonzero(va, vb)); } \
+		} \
+		scalar_compare<T, Op>(a_scalar ? a : x + i, a_scalar, b_scalar ? b : y + i, b_scalar, z + i, count - i);
+
+	template <typename Tr, VecOp vec_op, typename Op>
+	void sse2_binary(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count) {
+		SIMD_BINARY_KERNEL_BODY
+	}
+
+	template <typename Tr, VecOp vec_op, typename Op>
+	SIMD_TARGET_AVX2 void avx2_binary(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count) {
+		SIMD_BINARY_KERNEL_BODY
+	}
+
+	template <typename Tr, VecOp vec_op, typename Op>
+	void sse2_compare(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count) {
+		SIMD_COMPARE_KERNEL_BODY
+	}
+
+	template <typename Tr, VecOp vec_op, typename Op>
+	SIMD_TARGET_AVX2 void avx2_compare(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count) {
+		SIMD_COMPARE_KERNEL_BODY
+	}
+
+	// floor and ceil need SSE4.1, so there are only AVX2 versions
+	template <typename Tr, VecOp vec_op, typename Op>
+	SIMD_TARGET_AVX2 void avx2_unary(const void* a, void* out, ProgramCounterType count) {
+		typedef typename Tr::T T;
+		const T* x = (const T*)a;
+		T* z = (T*)out;
+		ProgramCounterType i = 0;
+		for (; i + Tr::width <= count; i += Tr::width) {
+			if constexpr (vec_op == VEC_FLOOR) {
+				Tr::store(z + i, Tr::floor(Tr::load(x + i)));
+			} else {
+				Tr::store(z + i, Tr::ceil(Tr::load(x + i)));
+			}
+		}
+		scalar_unary<T, Op>(x + i, z + i, count - i);
+	}
+
+	// Integer reductions wrap like the scalar ones, so lane order does not change the result.
+	// Float reductions are never vectorized, reordering would change rounding.
+	template <typename Tr, VecOp vec_op, typename Op>
+	SIMD_TARGET_AVX2 void avx2_reduce(const void* a, [[maybe_unused]] const void* b, ProgramCounterType count, void* out) {
+		typedef typename Tr::T T;
+		const T* x = (const T*)a;
+		if (count < Tr::width) {
+			T result = count > 0 ? x[0] : T(0);
+			for (ProgramCounterType i = 1; i < count; i++) {
+				result = Op::apply(result, x[i]);
+			}
+			*(T*)out = result;
+			return;
+		}
+		typename Tr::V acc = Tr::load(x);
+		ProgramCounterType i = Tr::width;
+		for (; i + Tr::width <= count; i += Tr::width) {
+			typename Tr::V current = Tr::load(x + i);
+			SIMD_VEC_APPLY(acc, acc, current)
+		}
+		T lanes[Tr::width];
+		Tr::store(lanes, acc);
+		T result = lanes[0];
+		for (int lane = 1; lane < Tr::width; lane++) {
+			result = Op::apply(result, lanes[lane]);
+		}
+		for (; i < count; i++) {
+			result = Op::apply(result, x[i]);
+		}
+		*(T*)out = result;
+	}
+
+	SIMD_TARGET_AVX2 void avx2_dot_int32(const void* a, const void* b, ProgramCounterType count, void* out) {
+		const Int32Type* x = (const Int32Type*)a;
+		const Int32Type* y = (const Int32Type*)b;
+		__m256i acc = _mm256_setzero_si256();
+		ProgramCounterType i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i product = _mm256_mullo_epi32(Avx2Int32::load(x + i), Avx2Int32::load(y + i));
+			acc = _mm256_add_epi32(acc, product);
+		}
+		Int32Type lanes[8];
+		Avx2Int32::store(lanes, acc);
+		Uint32Type result = 0;
+		for (int lane = 0; lane < 8; lane++) {
+			result += (Uint32Type)lanes[lane];
+		}
+		for (; i < count; i++) {
+			result += (Uint32Type)x[i] * (Uint32Type)y[i];
+		}
+		*(Int32Type*)out = (Int32Type)result;
+	}
+
+	struct OpMin { template <typename T> static T apply(T a, T b) { return b < a ? b : a; } };
+	struct OpMax { template <typename T> static T apply(T a, T b) { return b > a ? b : a; } };
+
+#endif
+
+	Level detect_level() {
+#ifdef SIMD_X86
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7) {
+			__cpuidex(info, 7, 0);
+			bool avx2 = (info[1] & (1 << 5)) != 0;
+			__cpuid(info, 1);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			if (avx2 && osxsave && (_xgetbv(0) & 6) == 6) {
+				return LEVEL_AVX2;
+			}
+		}
+		return LEVEL_SSE2;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return LEVEL_AVX2;
+		}
+		return LEVEL_SSE2;
+#endif
+#else
+		return LEVEL_SCALAR;
+#endif
+	}
+
+	Level get_level() {
+		static const Level level = detect_level();
+		return level;
+	}
+
+	std::string level_to_string(Level level) {
+		switch (level) {
+			case LEVEL_SCALAR: return "scalar";
+			case LEVEL_SSE2: return "sse2";
+			case LEVEL_AVX2: return "avx2";
+			default: return "unknown";
+		}
+	}
+
+	typedef std::pair<std::string, token_type> KernelKey;
+
+	std::map<KernelKey, BinaryKernel> create_binary_kernels(Level level) {
+		std::map<KernelKey, BinaryKernel> kernels = {
+			{ { "add", type_int32 }, scalar_binary<Int32Type, OpAdd> },
+			{ { "add", type_int64 }, scalar_binary<Int64Type, OpAdd> },
+			{ { "add", type_float }, scalar_binary<FloatDataType, OpAdd> },
+			{ { "add", type_double }, scalar_binary<DoubleDataType, OpAdd> },
+			{ { "sub", type_int32 }, scalar_binary<Int32Type, OpSub> },
+			{ { "sub", type_int64 }, scalar_binary<Int64Type, OpSub> },
+			{ { "sub", type_float }, scalar_binary<FloatDataType, OpSub> },
+			{ { "sub", type_double }, scalar_binary<DoubleDataType, OpSub> },
+			{ { "mul", type_int32 }, scalar_binary<Int32Type, OpMul> },
+			{ { "mul", type_int64 }, scalar_binary<Int64Type, OpMul> },
+			{ { "mul", type_float }, scalar_binary<FloatDataType, OpMul> },
+			{ { "mul", type_double }, scalar_binary<DoubleDataType, OpMul> },
+			{ { "div", type_float }, scalar_binary<FloatDataType, OpDiv> },
+			{ { "div", type_double }, scalar_binary<DoubleDataType, OpDiv> },
+			{ { "and", type_int32 }, scalar_compare<Int32Type, OpAnd> },
+			{ { "or", type_int32 }, scalar_compare<Int32Type, OpOr> },
+		};
+		auto add_compare = [&]<typename T>(token_type type) {
+			kernels[{ "cmp", type }] = scalar_compare<T, OpCmp>;
+			kernels[{ "lt", type }] = scalar_compare<T, OpLt>;
+			kernels[{ "gt", type }] = scalar_compare<T, OpGt>;
+		};
+		add_compare.operator()<Int32Type>(type_int32);
+		add_compare.operator()<Int64Type>(type_int64);
+		add_compare.operator()<Uint32Type>(type_uint32);
+		add_compare.operator()<Uint64Type>(type_uint64);
+		add_compare.operator()<FloatDataType>(type_float);
+		add_compare.operator()<DoubleDataType>(type_double);
+#ifdef SIMD_X86
+		if (level >= LEVEL_SSE2) {
+			kernels[{ "add", type_int32 }] = sse2_binary<Sse2Int32, VEC_ADD, OpAdd>;
+			kernels[{ "add", type_int64 }] = sse2_binary<Sse2Int64, VEC_ADD, OpAdd>;
+			kernels[{ "add", type_float }] = sse2_binary<Sse2Float, VEC_ADD, OpAdd>;
+			kernels[{ "add", type_double }] = sse2_binary<Sse2Double, VEC_ADD, OpAdd>;
+			kernels[{ "sub", type_int32 }] = sse2_binary<Sse2Int32, VEC_SUB, OpSub>;
+			kernels[{ "sub", type_int64 }] = sse2_binary<Sse2Int64, VEC_SUB, OpSub>;
+			kernels[{ "sub", type_float }] = sse2_binary<Sse2Float, VEC_SUB, OpSub>;
+			kernels[{ "sub", type_double }] = sse2_binary<Sse2Double, VEC_SUB, OpSub>;
+			kernels[{ "mul", type_float }] = sse2_binary<Sse2Float, VEC_MUL, OpMul>;
+			kernels[{ "mul", type_double }] = sse2_binary<Sse2Double, VEC_MUL, OpMul>;
+			kernels[{ "div", type_float }] = sse2_binary<Sse2Float, VEC_DIV, OpDiv>;
+			kernels[{ "div", type_double }] = sse2_binary<Sse2Double, VEC_DIV, OpDiv>;
+			kernels[{ "cmp", type_int32 }] = sse2_compare<Sse2Int32, VEC_CMP, OpCmp>;
+			kernels[{ "lt", type_int32 }] = sse2_compare<Sse2Int32, VEC_LT, OpLt>;
+			kernels[{ "gt", type_int32 }] = sse2_compare<Sse2Int32, VEC_GT, OpGt>;
+			kernels[{ "and", type_int32 }] = sse2_compare<Sse2Int32, VEC_AND, OpAnd>;
+			kernels[{ "or", type_int32 }] = sse2_compare<Sse2Int32, VEC_OR, OpOr>;
+			kernels[{ "cmp", type_float }] = sse2_compare<Sse2Float, VEC_CMP, OpCmp>;
+			kernels[{ "lt", type_float }] = sse2_compare<Sse2Float, VEC_LT, OpLt>;
+			kernels[{ "gt", type_float }] = sse2_compare<Sse2Float, VEC_GT, OpGt>;
+		}
+		if (level >= LEVEL_AVX2) {
+			kernels[{ "add", type_int32 }] = avx2_binary<Avx2Int32, VEC_ADD, OpAdd>;
+			kernels[{ "add", type_int64 }] = avx2_binary<Avx2Int64, VEC_ADD, OpAdd>;
+			kernels[{ "add", type_float }] = avx2_binary<Avx2Float, VEC_ADD, OpAdd>;
+			kernels[{ "add", type_double }] = avx2_binary<Avx2Double, VEC_ADD, OpAdd>;
+			kernels[{ "sub", type_int32 }] = avx2_binary<Avx2Int32, VEC_SUB, OpSub>;
+			kernels[{ "sub", type_int64 }] = avx2_binary<Avx2Int64, VEC_SUB, OpSub>;
+			kernels[{ "sub", type_float }] = avx2_binary<Avx2Float, VEC_SUB, OpSub>;
+			kernels[{ "sub", type_double }] = avx2_binary<Avx2Double, VEC_SUB, OpSub>;
+			kernels[{ "mul", type_int32 }] = avx2_binary<Avx2Int32, VEC_MUL, OpMul>;
+			kernels[{ "mul", type_float }] = avx2_binary<Avx2Float, VEC_MUL, OpMul>;
+			kernels[{ "mul", type_double }] = avx2_binary<Avx2Double, VEC_MUL, OpMul>;
+			kernels[{ "div", type_float }] = avx2_binary<Avx2Float, VEC_DIV, OpDiv>;
+			kernels[{ "div", type_double }] = avx2_binary<Avx2Double, VEC_DIV, OpDiv>;
+			kernels[{ "cmp", type_int32 }] = avx2_compare<Avx2Int32, VEC_CMP, OpCmp>;
+			kernels[{ "lt", type_int32 }] = avx2_compare<Avx2Int32, VEC_LT, OpLt>;
+			kernels[{ "gt", type_int32 }] = avx2_compare<Avx2Int32, VEC_GT, OpGt>;
+			kernels[{ "and", type_int32 }] = avx2_compare<Avx2Int32, VEC_AND, OpAnd>;
+			kernels[{ "or", type_int32 }] = avx2_compare<Avx2Int32, VEC_OR, OpOr>;
+			kernels[{ "cmp", type_float }] = avx2_compare<Avx2Float, VEC_CMP, OpCmp>;
+			kernels[{ "lt", type_float }] = avx2_compare<Avx2Float, VEC_LT, OpLt>;
+			kernels[{ "gt", type_float }] = avx2_compare<Avx2Float, VEC_GT, OpGt>;
+		}
+#endif
+		return kernels;
+	}
+
+	std::map<KernelKey, UnaryKernel> create_unary_kernels(Level level) {
+		std::map<KernelKey, UnaryKernel> kernels = {
+			{ { "floor", type_float }, scalar_unary<FloatDataType, OpFloor> },
+			{ { "floor", type_double }, scalar_unary<DoubleDataType, OpFloor> },
+			{ { "ceil", type_float }, scalar_unary<FloatDataType, OpCeil> },
+			{ { "ceil", type_double }, scalar_unary<DoubleDataType, OpCeil> },
+		};
+#ifdef SIMD_X86
+		if (level >= LEVEL_AVX2) {
+			kernels[{ "floor", type_float }] = avx2_unary<Avx2Float, VEC_FLOOR, OpFloor>;
+			kernels[{ "floor", type_double }] = avx2_unary<Avx2Double, VEC_FLOOR, OpFloor>;
+			kernels[{ "ceil", type_float }] = avx2_unary<Avx2Float, VEC_CEIL, OpCeil>;
+			kernels[{ "ceil", type_double }] = avx2_unary<Avx2Double, VEC_CEIL, OpCeil>;
+		}
+#endif
+		return kernels;
+	}
+
+	std::map<KernelKey, ReduceKernel> create_reduce_kernels(Level level) {
+		std::map<KernelKey, ReduceKernel> kernels;
+		auto add_typed = [&]<typename T>(token_type type) {
+			kernels[{ "sum", type }] = scalar_sum<T>;
+			kernels[{ "min", type }] = scalar_min<T>;
+			kernels[{ "max", type }] = scalar_max<T>;
+			kernels[{ "dot", type }] = scalar_dot<T>;
+		};
+		add_typed.operator()<Int32Type>(type_int32);
+		add_typed.operator()<Int64Type>(type_int64);
+		add_typed.operator()<Uint32Type>(type_uint32);
+		add_typed.operator()<Uint64Type>(type_uint64);
+		add_typed.operator()<FloatDataType>(type_float);
+		add_typed.operator()<DoubleDataType>(type_double);
+#ifdef SIMD_X86
+		if (level >= LEVEL_AVX2) {
+			kernels[{ "sum", type_int32 }] = avx2_reduce<Avx2Int32, VEC_ADD, OpAdd>;
+			kernels[{ "sum", type_int64 }] = avx2_reduce<Avx2Int64, VEC_ADD, OpAdd>;
+			kernels[{ "min", type_int32 }] = avx2_reduce<Avx2Int32, VEC_MIN, OpMin>;
+			kernels[{ "max", type_int32 }] = avx2_reduce<Avx2Int32, VEC_MAX, OpMax>;
+			kernels[{ "dot", type_int32 }] = avx2_dot_int32;
+		}
+#endif
+		return kernels;
+	}
+
+	BinaryKernel get_binary_kernel(std::string op, token_type type) {
+		static const std::map<KernelKey, BinaryKernel> kernels = create_binary_kernels(get_level());
+		auto it = kernels.find({ op, type });
+		return it != kernels.end() ? it->second : nullptr;
+	}
+
+	token_type get_binary_result_type(std::string op, token_type type) {
+		if (op == "cmp" || op == "lt" || op == "gt" || op == "and" || op == "or") {
+			return CMP_RETURN_TYPE;
+		}
+		return type;
+	}
+
+	UnaryKernel get_unary_kernel(std::string op, token_type type) {
+		static const std::map<KernelKey, UnaryKernel> kernels = create_unary_kernels(get_level());
+		auto it = kernels.find({ op, type });
+		return it != kernels.end() ? it->second : nullptr;
+	}
+
+	ReduceKernel get_reduce_kernel(std::string op, token_type type) {
+		static const std::map<KernelKey, ReduceKernel> kernels = create_reduce_kernels(get_level());
+		auto it = kernels.find({ op, type });
+		return it != kernels.end() ? it->second : nullptr;
+	}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include "types.h"
+
+// Typed kernels over contiguous buffers, selected once for the running CPU.
+// Every kernel gives the same results as applying the Token function to each element.
+namespace simd {
+
+	enum Level {
+		LEVEL_SCALAR,
+		LEVEL_SSE2,
+		LEVEL_AVX2,
+	};
+
+	// a_scalar / b_scalar: operand is a single value broadcast over count elements
+	typedef void (*BinaryKernel)(const void* a, bool a_scalar, const void* b, bool b_scalar, void* out, ProgramCounterType count);
+	typedef void (*UnaryKernel)(const void* a, void* out, ProgramCounterType count);
+	// b is used by dot only, out points to one element
+	typedef void (*ReduceKernel)(const void* a, const void* b, ProgramCounterType count, void* out);
+
+	Level get_level();
+	std::string level_to_string(Level level);
+	BinaryKernel get_binary_kernel(std::string op, token_type type);
+	// element type of the output of a binary kernel, comparisons and logic write CMP_RETURN_TYPE
+	token_type get_binary_result_type(std::string op, token_type type);
+	UnaryKernel get_unary_kernel(std::string op, token_type type);
+	ReduceKernel get_reduce_kernel(std::string op, token_type type);
+
+}
@@ -2,10 +2,43 @@
 
 namespace test {
 
+	struct TestConfig {
+		std::string name;
+		bool fold_constants = false;
+		bool fuse_instructions = false;
+		bool eager_reduction = false;
+		bool jit = false;
+		bool trace = false;
+	};
+
 	const std::filesystem::path test_directory = "tests/";
+	const std::vector<TestConfig> test_configs = {
+		{ .name = "default" },
+		{
+			.name = "fold_constants",
+			.fold_constants = true,
+		},
+		{
+			.name = "fuse_instructions",
+			.fuse_instructions = true,
+		},
+		{
+			.name = "eager_reduction",
+			.eager_reduction = true,
+		},
+		{
+			.name = "jit",
+			.jit = true,
+		},
+		{
+			.name = "trace",
+			.trace = true,
+		},
+	};
 	const std::vector<std::filesystem::path> test_list = {
 		"math.bvmi",
 		"mod.bvmi",
+		"mod_int64.bvmi",
 		"pow.bvmi",
 		"basic.bvmi",
 		"label.bvmi",
@@ -140,6 +173,208 @@ namespace test {
 		"macro_4.bvmi",
 		"macro_5.bvmi",
 		"macro_6.bvmi",
+		"fold_1.bvmi",
+		"fuse_1.bvmi",
+		"eager_1.bvmi",
+		"array_1.bvmi",
+		"array_2.bvmi",
+		"list_math_1.bvmi",
+		"reduce_1.bvmi",
+		"list_math_2.bvmi",
+		"list_ops_1.bvmi",
+		"map_1.bvmi",
+		"map_2.bvmi",
+		"heap_1.bvmi",
+		"file_1.bvmi",
+		"read_1.bvmi",
+		"param_1.bvmi",
+		"parse_args_1.bvmi",
+		"freeze_1.bvmi",
+		"nav_1.bvmi",
+		"block_1.bvmi",
+		"block_2.bvmi",
+		"block_3.bvmi",
+		"native_1.bvmi",
+		"jit_1.bvmi",
+	};
+
+	// native instructions used by native_1.bvmi
+	void register_test_natives() {
+		static bool registered = false;
+		if (registered) {
+			return;
+		}
+		registered = true;
+		register_native("fnv32", 1, [](const std::vector<NativeArg>& args) {
+			Uint32Type hash = 2166136261u;
+			for (const Token& elem : args[0].elements) {
+				hash = (hash ^ (elem.get_data_cast<Uint32Type>() & 0xFF)) * 16777619u;
+			}
+			Token result;
+			result.type = type_uint32;
+			result.set_data<Uint32Type>(hash);
+			return std::vector<Token>{ result };
+		});
+		register_native("divmod", 2, [](const std::vector<NativeArg>& args) {
+			Int32Type first = args[0].number.get_data_cast<Int32Type>();
+			Int32Type second = args[1].number.get_data_cast<Int32Type>();
+			if (args[0].is_list || args[1].is_list || second == 0) {
+				throw std::runtime_error("Expected two numbers, second one not zero");
+			}
+			Token quotient;
+			quotient.set_data<Int32Type>(first / second);
+			Token remainder;
+			remainder.set_data<Int32Type>(first % second);
+			return std::vector<Token>{ quotient, remainder };
+		});
+	}
+
+	// Tests that need the Interpreter API, as binding parameters from the host or expecting an error,
+	// so they are not test files. Every check returns the failure message or an empty string.
+	const std::string bind_program = "mul param n 2\nsum param xs\n";
+	const std::vector<std::pair<std::string, std::function<std::string()>>> api_tests = {
+		{ "number_and_list", []() {
+			Interpreter program(bind_program);
+			program.bind("n", Token("5"));
+			program.bind_list("xs", Token::str_to_tokens("1 2 3"));
+			std::string results = Token::tokens_to_str(program.execute());
+			return results == "10 6" ? "" : "Results: " + results;
+		} },
+		{ "copied_interpreter", []() {
+			Interpreter program(bind_program);
+			Interpreter copy = program;
+			program.bind("n", Token("5"));
+			program.bind_list("xs", Token::str_to_tokens("1 2 3"));
+			copy.bind("n", Token("-4"));
+			copy.bind_list("xs", Token::str_to_tokens("7 8 9"));
+			std::string results = Token::tokens_to_str(program.execute());
+			std::string copy_results = Token::tokens_to_str(copy.execute());
+			return results == "10 6" && copy_results == "-8 24" ? "" : "Results: " + results + ", copy results: " + copy_results;
+		} },
+		{ "unknown_name", []() {
+			Interpreter program(bind_program);
+			try {
+				program.bind("m", Token("5"));
+			} catch (std::exception exc) {
+				std::string message = exc.what();
+				return message.find("Unknown parameter: m") != std::string::npos ? "" : "Error: " + message;
+			}
+			return std::string("No error");
+		} },
+		{ "fold_constants", []() {
+			Compiler compiler;
+			compiler.fold_constants = true;
+			// the del offset reaches into the add, the ins argument is inserted as written
+			std::string folded = Token::tokens_to_str(compiler.compile("mul add 1 2 sub 5 1\nadd 5 6\ndel -2\nins 0 add 2 3"));
+			return folded == "12 add 5 6 del -2 ins 0 add 2 3" ? "" : "Folded: " + folded;
+		} },
+		{ "collect_garbage", []() {
+			// 7 and 8 are not reachable from the sequence
+			Interpreter program("7\n8\nseq\n    add 1 1\n    add 2 2\n    add 3 3\nend\n");
+			program.collect_garbage = true;
+			program.gc_interval = 1;
+			std::string results = Token::tokens_to_str(program.execute());
+			return results == "seq 2 4 6 end" && program.gc_collected_count == 2 ? "" : "Results: " + results;
+		} },
+		{ "collect_garbage_computed_address", []() {
+			// get reads the 7 through an address computed by add, so nothing can be collected before it runs
+			Interpreter program("seq\n    add 1 1\n    add 1 1\n    get add 1 2\nend\n42\n7\n");
+			program.collect_garbage = true;
+			program.gc_interval = 1;
+			std::string results = Token::tokens_to_str(program.execute());
+			return results == "seq 2 2 7 end" ? "" : "Results: " + results;
+		} },
+		{ "cycle_detection", []() {
+			// the outer sequence copies itself after its end and flips a every time
+			Interpreter program(
+				"useq :outer_sp\n"
+				"    useq :sp\n"
+				"        cpy sp outer_sp_end\n"
+				"        set a not get a\n"
+				"    end :sp_end\n"
+				"end :outer_sp_end\n"
+				"1 :a\n"
+			);
+			program.detect_cycles = true;
+			program.max_iterations = 1000;
+			try {
+				program.execute();
+			} catch (std::exception exc) {
+				std::string message = exc.what();
+				if (message.find("Cycle detected: period 10") == std::string::npos || program.cycle_length != 10) {
+					return "Error: " + message;
+				}
+				return std::string();
+			}
+			return std::string("No cycle detected");
+		} },
+		{ "invalid_free", []() {
+			// p + 8 is inside of p, the bytes before it were written as if they were a header
+			Interpreter program(
+				"useq\n"
+				"    malloc :p 8\n"
+				"    malloc :p2 8\n"
+				"    store get p 4\n"
+				"    store add get p 4 1\n"
+				"    free add get p 8\n"
+				"    malloc 8\n"
+				"end\n"
+			);
+			try {
+				program.execute();
+			} catch (std::exception exc) {
+				std::string message = exc.what();
+				return message.find("Invalid heap address in free: 16") != std::string::npos ? "" : "Error: " + message;
+			}
+			return "No error, results: " + Token::tokens_to_str(program.tokens);
+		} },
+		{ "input_not_ready", []() {
+			// the source has no data four times out of five and then gives one byte, so instructions
+			// wait for many iterations while the tokens do not change
+			Interpreter program(
+				"useq\n"
+				"    readline\n"
+				"    read 1\n"
+				"    readline\n"
+				"    eof\n"
+				"    readline\n"
+				"    read 5\n"
+				"end\n"
+			);
+			InputBuffer::Source source = InputBuffer::string_source("ab\ncde");
+			std::shared_ptr<ProgramCounterType> calls = std::make_shared<ProgramCounterType>(0);
+			std::shared_ptr<ProgramCounterType> empty_calls = std::make_shared<ProgramCounterType>(0);
+			program.input.set_source([source, calls, empty_calls](char* data, ProgramCounterType size) -> Int64Type {
+				if (++*calls % 5 != 0) {
+					++*empty_calls;
+					return 0;
+				}
+				return source(data, 1);
+			});
+			program.detect_cycles = true;
+			program.max_iterations = 10000;
+			std::string results = Token::tokens_to_str(program.execute());
+			if (results != "list 97 98 end list 99 end list 100 101 end 1 list end list end" || *empty_calls == 0) {
+				return "Results: " + results + ", empty calls: " + std::to_string(*empty_calls);
+			}
+			return std::string();
+		} },
+		{ "freeze_releases_trees", []() {
+			ProgramCounterType table_size = SharedTree::get_intern_table_size();
+			std::string results;
+			ProgramCounterType live_table_size;
+			{
+				Interpreter program("freeze list 1 end\nfreeze list 2 end\nfreeze list 3 end\n");
+				results = Token::tokens_to_str(program.execute());
+				live_table_size = SharedTree::get_intern_table_size();
+			}
+			ProgramCounterType released_table_size = SharedTree::get_intern_table_size();
+			if (live_table_size != table_size + 3 || released_table_size != table_size) {
+				return "Results: " + results + ", table sizes: " + std::to_string(table_size) + " "
+					+ std::to_string(live_table_size) + " " + std::to_string(released_table_size);
+			}
+			return std::string();
+		} },
 	};
 
 	bool is_terminating_char(char c) {
@@ -198,7 +433,7 @@ namespace test {
 		}
 	}
 
-	void tokenize(std::string str, std::string& correct_results_p, std::string& correct_print_p) {
+	void tokenize(std::string str, std::string& correct_results_p, std::string& correct_print_p, std::string& input_p) {
 		ProgramCounterType current_line = 1;
 		try {
 			enum TokenizerState {
@@ -206,11 +441,14 @@ namespace test {
 				STATE_CORRECT_RESULTS,
 				STATE_AFTER_CORRECT_RESULTS,
 				STATE_CORRECT_PRINT,
+				STATE_AFTER_CORRECT_PRINT,
+				STATE_INPUT,
 			};
 			TokenizerState state = STATE_BEGIN;
 			std::string program_text;
 			std::string correct_results;
 			std::string correct_print;
+			std::string input;
 			str += EOF;
 			auto throw_unexp_char = [](char c) {
 				throw std::runtime_error("Unexpected char: " + utils::char_to_str(c));
@@ -243,12 +481,26 @@ namespace test {
 					}
 				} else if (state == STATE_CORRECT_PRINT) {
 					if (utils::is_newline(current_char)) {
-						break;
+						state = STATE_AFTER_CORRECT_PRINT;
 					} else if (current_char == EOF) {
 						throw_unexp_char(current_char);
 					} else {
 						correct_print += current_char;
 					}
+				} else if (state == STATE_AFTER_CORRECT_PRINT) {
+					if (current_char == '#') {
+						state = STATE_INPUT;
+					} else {
+						break;
+					}
+				} else if (state == STATE_INPUT) {
+					if (utils::is_newline(current_char)) {
+						break;
+					} else if (current_char == EOF) {
+						throw_unexp_char(current_char);
+					} else {
+						input += current_char;
+					}
 				}
 				if (utils::is_newline(current_char)) {
 					current_line++;
@@ -256,13 +508,14 @@ namespace test {
 			}
 			correct_results_p = correct_results;
 			correct_print_p = correct_print;
+			input_p = input;
 		} catch (std::exception exc) {
 			throw std::runtime_error("Line " + std::to_string(current_line) + ": " + std::string(exc.what()));
 		}
 	}
 
 	bool run_test(
-		std::filesystem::path test_path,
+		std::filesystem::path test_path, const TestConfig& config,
 		std::vector<Token>& actual_results_p, std::vector<Token>& correct_results_p,
 		std::string& actual_print_p, std::string& correct_print_p,
 		bool& results_compare_p, bool& print_compare_p
@@ -276,8 +529,10 @@ namespace test {
 		std::string program_text = utils::file_to_str(test_path);
 		std::string correct_results_str;
 		std::string correct_print_str;
-		tokenize(program_text, correct_results_str, correct_print_str);
+		std::string input_str;
+		tokenize(program_text, correct_results_str, correct_print_str, input_str);
 		correct_print_str = utils::replace_escape_seq(correct_print_str);
+		input_str = utils::replace_escape_seq(input_str);
 		std::vector<bool> approx_flags = get_approx_flags(correct_results_str);
 		remove_approx_flags(correct_results_str);
 		std::vector<Token> correct_results;
@@ -286,7 +541,20 @@ namespace test {
 		} catch (std::exception exc) {
 			throw std::runtime_error("Cannot parse correct results: " + std::string(exc.what()));
 		}
-		Interpreter program(program_text);
+		Compiler compiler;
+		compiler.fold_constants = config.fold_constants;
+		compiler.fuse_instructions = config.fuse_instructions;
+		Interpreter program(program_text, compiler);
+		program.fuse_instructions = config.fuse_instructions;
+		program.eager_reduction = config.eager_reduction;
+		program.jit = config.jit;
+		program.jit_verify = true;
+		program.jit_cache.hot_count = 0;
+		if (config.trace) {
+			program.tracer = std::make_shared<trace::Recorder>();
+		}
+		program.detect_cycles = true;
+		program.input.set_source(InputBuffer::string_source(input_str));
 		std::vector<Token> actual_results;
 		try {
 			actual_results = program.execute();
@@ -305,6 +573,7 @@ namespace test {
 
 	void run_tests() {
 		try {
+			register_test_natives();
 			if (!std::filesystem::exists(test_directory)) {
 				throw std::runtime_error(test_directory.string() + " not found");
 			}
@@ -332,47 +601,68 @@ namespace test {
 			std::cout << "Running tests in " << test_directory << "\n";
 			int passed_count = 0;
 			std::vector<std::string> failed_list;
-			for (std::filesystem::path test_filename : test_list) {
-				std::filesystem::path test_path = test_directory / test_filename;
-				std::vector<Token> actual_results;
-				std::vector<Token> correct_results;
-				std::string actual_print;
-				std::string correct_print;
-				bool results_compare;
-				bool print_compare;
-				bool passed = false;
-				bool exception = false;
-				std::string exc_message;
+			for (const TestConfig& config : test_configs) {
+				std::cout << "Config: " << config.name << "\n";
+				for (std::filesystem::path test_filename : test_list) {
+					std::filesystem::path test_path = test_directory / test_filename;
+					std::vector<Token> actual_results;
+					std::vector<Token> correct_results;
+					std::string actual_print;
+					std::string correct_print;
+					bool results_compare;
+					bool print_compare;
+					bool passed = false;
+					bool exception = false;
+					std::string exc_message;
+					try {
+						passed = run_test(
+							test_path, config,
+							actual_results, correct_results,
+							actual_print, correct_print,
+							results_compare, print_compare
+						);
+					} catch (std::exception exc) {
+						exception = true;
+						exc_message = exc.what();
+					}
+					std::string filename = config.name + "/" + test_filename.string();
+					if (passed) {
+						passed_count++;
+						std::cout << "    passed: " << filename << "\n";
+					} else {
+						failed_list.push_back(filename);
+						std::cout << "    FAILED: " << filename << "\n";
+						if (exception) {
+							std::cout << "        ERROR: " << exc_message << "\n";
+						} else {
+							if (!results_compare) {
+								std::cout << "        Correct results: " + Token::tokens_to_str(correct_results) << "\n";
+								std::cout << "         Actual results: " + Token::tokens_to_str(actual_results) << "\n";
+							}
+							if (!print_compare) {
+								std::cout << "        Correct print: " + correct_print << "\n";
+								std::cout << "         Actual print: " + actual_print << "\n";
+							}
+						}
+					}
+				}
+			}
+			std::cout << "API tests\n";
+			for (const auto& [name, check] : api_tests) {
+				std::string filename = "api/" + name;
+				std::string message;
 				try {
-					passed = run_test(
-						test_path,
-						actual_results, correct_results,
-						actual_print, correct_print,
-						results_compare, print_compare
-					);
+					message = check();
 				} catch (std::exception exc) {
-					exception = true;
-					exc_message = exc.what();
+					message = "ERROR: " + std::string(exc.what());
 				}
-				std::string filename = test_filename.string();
-				if (passed) {
+				if (message.empty()) {
 					passed_count++;
 					std::cout << "    passed: " << filename << "\n";
 				} else {
 					failed_list.push_back(filename);
 					std::cout << "    FAILED: " << filename << "\n";
-					if (exception) {
-						std::cout << "        ERROR: " << exc_message << "\n";
-					} else {
-						if (!results_compare) {
-							std::cout << "        Correct results: " + Token::tokens_to_str(correct_results) << "\n";
-							std::cout << "         Actual results: " + Token::tokens_to_str(actual_results) << "\n";
-						}
-						if (!print_compare) {
-							std::cout << "        Correct print: " + correct_print << "\n";
-							std::cout << "         Actual print: " + actual_print << "\n";
-						}
-					}
+					std::cout << "        " << message << "\n";
 				}
 			}
 			std::cout << "\n";
@@ -1,5 +1,8 @@
 #include "token.h"
+#include "object.h"
 #include <ranges>
+#include <bit>
+#include <map>
 
 Token::Token() {}
 
@@ -49,13 +52,20 @@ Token::Token(std::string str) {
 			if (instr.index < 0) {
 				throw std::runtime_error("Instruction not found: " + str);
 			}
-			set_data<InstructionDataType>(get_instruction_info(str).index);
+			set_data<InstructionDataType>(instr.index);
+			node_flags = get_node_flags(instr.index);
 		}
 	} catch (std::exception exc) {
 		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
 	}
 }
 
+Token::Token(std::shared_ptr<TokenObject> object) {
+	this->type = type_object;
+	this->object = object;
+	this->str = "<" + object->name() + ">";
+}
+
 bool Token::is_num() {
 	switch (type) {
 		case type_int32:
@@ -78,12 +88,20 @@ bool Token::is_num_or_ptr() {
 	return is_num() || is_ptr();
 }
 
+bool Token::is_object() {
+	return type == type_object;
+}
+
+bool Token::is_value() {
+	return is_num_or_ptr() || is_object();
+}
+
 bool Token::is_static() {
-	return is_num_or_ptr() || str == "q";
+	return is_value() || (node_flags & NODE_QUOTE);
 }
 
 bool Token::is_container_header() {
-	return utils::is_container_name(str);
+	return node_flags & NODE_CONTAINER;
 }
 
 void Token::cast(token_type new_type) {
@@ -100,6 +118,8 @@ void Token::cast(token_type new_type) {
 			default: throw std::runtime_error("Unknown token_data type: " + std::to_string(new_type));
 		}
 		type = new_type;
+		node_flags = type == type_instr && get_instruction_info(get_data<InstructionDataType>()).index >= 0
+			? get_node_flags(get_data<InstructionDataType>()) : 0;
 	} catch (std::exception exc) {
 		throw std::runtime_error(__FUNCTION__": " + std::string(exc.what()));
 	}
@@ -121,9 +141,11 @@ std::string Token::to_string() const {
 			case type_double:
 				return std::to_string(data.m_double);
 			case type_instr:
-				return INSTRUCTION_LIST[get_data<InstructionDataType>()].str;
+				return get_instruction_str(get_data<InstructionDataType>());
 			case type_ptr:
 				return std::to_string(get_data<PointerDataType>()) + "p";
+			case type_object:
+				return object->to_string();
 			default:
 				throw std::runtime_error("Unknown token_data type: " + std::to_string(type));
 		}
@@ -132,6 +154,28 @@ std::string Token::to_string() const {
 	}
 }
 
+utils::LongNumberType Token::hash() const {
+	utils::LongNumberType bits;
+	switch (type) {
+		case type_int32: bits = (Uint32Type)data.m_int32; break;
+		case type_int64: bits = data.m_int64; break;
+		case type_uint32: bits = data.m_uint32; break;
+		case type_uint64: bits = data.m_uint64; break;
+		case type_float:
+			bits = std::isnan(data.m_float) ? 0 : std::bit_cast<Uint32Type>(data.m_float);
+			break;
+		case type_double:
+			bits = std::isnan(data.m_double) ? 0 : std::bit_cast<Uint64Type>(data.m_double);
+			break;
+		case type_instr: bits = get_data<InstructionDataType>(); break;
+		case type_ptr: bits = get_data<PointerDataType>(); break;
+		// contents can change in place, object writes are hashed separately
+		case type_object: bits = object->id; break;
+		default: throw std::runtime_error("Unknown token_data type: " + std::to_string(type));
+	}
+	return utils::hash_combine(type, bits);
+}
+
 token_type Token::get_return_type(token_type type1, token_type type2) {
 	try {
 		if (type1 == type_double || type2 == type_double) {
@@ -413,6 +457,79 @@ Token Token::gt(const Token& first, const Token& second) {
 	TOKEN_BINARY_OP_CMP( return a > b; )
 }
 
+Token::UnaryFunc Token::get_unary_func(std::string str) {
+	static const std::map<std::string, UnaryFunc> unary_funcs = {
+		{ "log", Token::log },
+		{ "log2", Token::log2 },
+		{ "sin", Token::sin },
+		{ "cos", Token::cos },
+		{ "tan", Token::tan },
+		{ "asin", Token::asin },
+		{ "acos", Token::acos },
+		{ "atan", Token::atan },
+		{ "floor", Token::floor },
+		{ "ceil", Token::ceil },
+		{ "not", Token::not_op },
+	};
+	auto it = unary_funcs.find(str);
+	return it != unary_funcs.end() ? it->second : nullptr;
+}
+
+Token::BinaryFunc Token::get_binary_func(std::string str) {
+	static const std::map<std::string, BinaryFunc> binary_funcs = {
+		{ "add", Token::add },
+		{ "sub", Token::sub },
+		{ "mul", Token::mul },
+		{ "div", Token::div },
+		{ "mod", Token::mod },
+		{ "pow", Token::pow },
+		{ "atan2", Token::atan2 },
+		{ "cmp", Token::cmp },
+		{ "lt", Token::lt },
+		{ "gt", Token::gt },
+		{ "and", Token::and_op },
+		{ "or", Token::or_op },
+		{ "xor", Token::xor_op },
+	};
+	auto it = binary_funcs.find(str);
+	return it != binary_funcs.end() ? it->second : nullptr;
+}
+
+Token::FusedKind Token::match_fused(std::vector<Token>& tokens, ProgramCounterType index) {
+	auto matches = [&](ProgramCounterType offset, auto pred) {
+		return index + offset < tokens.size() && pred(tokens[index + offset]);
+	};
+	auto is_instr = [](const char* str) {
+		return [=](Token& token) { return !token.is_num_or_ptr() && token.str == str; };
+	};
+	auto is_binary_func = [](Token& token) { return !token.is_num_or_ptr() && get_binary_func(token.str); };
+	auto is_num = [](Token& token) { return token.is_num(); };
+	auto is_num_or_ptr = [](Token& token) { return token.is_num_or_ptr(); };
+	auto func_get_at = [&](ProgramCounterType offset) {
+		return matches(offset, is_binary_func)
+			&& matches(offset + 1, is_instr("get"))
+			&& matches(offset + 2, is_num_or_ptr)
+			&& matches(offset + 3, is_num);
+	};
+	if (matches(0, is_instr("set")) && matches(1, is_num_or_ptr) && func_get_at(2)) {
+		return FUSED_SET_FUNC_GET;
+	} else if (func_get_at(0)) {
+		return FUSED_FUNC_GET;
+	} else if (
+		matches(0, is_instr("print")) && matches(1, is_instr("str"))
+		&& matches(2, is_instr("get")) && matches(3, is_num_or_ptr)
+	) {
+		return FUSED_PRINT_STR_GET;
+	}
+	return FUSED_NONE;
+}
+
+void Token::mark_fused(std::vector<Token>& tokens, ProgramCounterType begin, ProgramCounterType end) {
+	for (ProgramCounterType i = begin; i < end && i < tokens.size(); i++) {
+		tokens[i].fused = match_fused(tokens, i);
+	}
+}
+
 bool operator==(const Token& first, const Token& second) {
 	try {
 		if (first.type != second.type) {
@@ -441,6 +558,8 @@ bool operator==(const Token& first, const Token& second) {
 				return first.get_data<InstructionDataType>() == second.get_data<InstructionDataType>();
 			case type_ptr:
 				return first.get_data<PointerDataType>() == second.get_data<PointerDataType>();
+			case type_object:
+				return first.object == second.object || first.object->equals(*second.object);
 			default:
 				throw std::runtime_error("Unknown token_data type: " + std::to_string(first.type));
 		}
@@ -451,6 +570,9 @@ bool operator==(const Token& first, const Token& second) {
 
 bool numeric_compare(const Token& first, const Token& second) {
 	try {
+		if ((first.type == type_object) != (second.type == type_object)) {
+			return false;
+		}
 		switch (first.type) {
 			case type_int32:
 				return first.data.m_int32 == second.data.m_int32;
@@ -468,6 +590,8 @@ bool numeric_compare(const Token& first, const Token& second) {
 				return first.get_data<InstructionDataType>() == second.get_data<InstructionDataType>();
 			case type_ptr:
 				return first.get_data<PointerDataType>() == second.get_data<PointerDataType>();
+			case type_object:
+				return first.object == second.object || first.object->equals(*second.object);
 			default:
 				throw std::runtime_error("Unknown token_data type: " + std::to_string(first.type));
 		}
@@ -498,6 +622,8 @@ bool approx_compare(const Token& first, const Token& second, float epsilon) {
 				return first.get_data<InstructionDataType>() == second.get_data<InstructionDataType>();
 			case type_ptr:
 				return first.get_data<PointerDataType>() == second.get_data<PointerDataType>();
+			case type_object:
+				return first.object == second.object || first.object->equals(*second.object);
 			default:
 				throw std::runtime_error("Unknown token_data type: " + std::to_string(first.type));
 		}
@@ -506,16 +632,6 @@ bool approx_compare(const Token& first, const Token& second, float epsilon) {
 	}
 }
 
-std::vector<Token> Token::tokenize(std::vector<Token>& tokens) {
-	std::vector<Token> result_tokens;
-	result_tokens.push_back(tokens[first_index]);
-	for (ProgramCounterType i = 0; i < arguments.size(); i++) {
-		std::vector<Token> arg_tokens = tokens[arguments[i]].tokenize(tokens);
-		result_tokens.insert(result_tokens.end(), arg_tokens.begin(), arg_tokens.end());
-	}
-	return result_tokens;
-}
-
 Token& Token::get_parent(std::vector<Token>& tokens) {
 	return tokens[tokens[first_index].parent_index];
 }
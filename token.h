@@ -1,32 +1,62 @@
 #pragma once
 
 #include <string>
+#include <memory>
 #include "utils.h"
 #include "instruction.h"
 #include "types.h"
 
+class TokenObject;
+
 class Token {
 public:
+	typedef Token (*UnaryFunc)(const Token& arg);
+	typedef Token (*BinaryFunc)(const Token& first, const Token& second);
+	// superinstructions, each one stands for a fixed token pattern starting at the marked token
+	enum FusedKind {
+		FUSED_NONE,
+		FUSED_FUNC_GET, // f get Q N
+		FUSED_SET_FUNC_GET, // set P f get Q N
+		FUSED_PRINT_STR_GET, // print str get Q
+	};
+
 	std::string str;
 	std::string orig_str = "<token_orig_str>";
 	token_type type = type_int32;
+	std::shared_ptr<TokenObject> object;
 
 	PointerDataType parent_index = -1;
 	ProgramCounterType arg_count = 0;
-	std::vector<PointerDataType> arguments;
 	ProgramCounterType first_index;
 	ProgramCounterType last_index;
+	// first token at or after this one that is not a value, set by parse
+	ProgramCounterType next_instruction_index = 0;
+	// set when an op writes the token or deletes tokens next to it, parse folds it into subtree_changed
+	bool changed = false;
+	bool subtree_changed = false;
+	// the instruction could not execute last time it was tried
+	bool blocked = false;
+	FusedKind fused = FUSED_NONE;
+	// set for instructions when the token is created, parent_flags is set by parse
+	NodeFlags node_flags = 0;
+	NodeFlags parent_flags = 0;
+	// interpreter that runs the contents of a block header across iterations, 0 until the block first runs
+	Uint64Type block_id = 0;
 
 	Token();
 	Token(std::string str, token_type type);
 	Token(std::string str);
+	Token(std::shared_ptr<TokenObject> object);
 	bool is_num();
 	bool is_ptr();
 	bool is_num_or_ptr();
+	bool is_object();
+	bool is_value();
 	bool is_static();
 	bool is_container_header();
 	void cast(token_type new_type);
 	std::string to_string() const;
+	utils::LongNumberType hash() const;
 	static token_type get_return_type(token_type type1, token_type type2);
 	static bool is_int_type(token_type type);
 	static std::string tokens_to_str(std::vector<Token> tokens);
@@ -58,6 +88,10 @@ public:
 	static Token cmp(const Token& first, const Token& second);
 	static Token lt(const Token& first, const Token& second);
 	static Token gt(const Token& first, const Token& second);
+	static UnaryFunc get_unary_func(std::string str);
+	static BinaryFunc get_binary_func(std::string str);
+	static FusedKind match_fused(std::vector<Token>& tokens, ProgramCounterType index);
+	static void mark_fused(std::vector<Token>& tokens, ProgramCounterType begin, ProgramCounterType end);
 
 	template <typename T>
 	static token_type get_token_type() {
@@ -140,7 +174,6 @@ public:
 		}
 	}
 
-	std::vector<Token> tokenize(std::vector<Token>& tokens);
 	Token& get_parent(std::vector<Token>& tokens);
 	ProgramCounterType get_parent_count(std::vector<Token>& tokens);
 	bool has_parent();
@@ -0,0 +1,193 @@
+#include "trace.h"
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace trace {
+
+	static thread_local ProgramCounterType thread_lane = 0;
+
+	// buffer the thread used last, looked up again when the recorder or lane changes
+	struct BufferCache {
+		Uint64Type recorder_id = 0;
+		ProgramCounterType lane = 0;
+		void* buffer = nullptr;
+	};
+	static thread_local BufferCache buffer_cache;
+
+	void set_thread_lane(ProgramCounterType lane) {
+		thread_lane = lane;
+	}
+
+	Recorder::Recorder() {
+		static std::atomic<Uint64Type> next_id = 1;
+		id = next_id++;
+		start = std::chrono::steady_clock::now();
+	}
+
+	Int64Type Recorder::now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	Recorder::LaneBuffer& Recorder::get_buffer() {
+		if (buffer_cache.recorder_id == id && buffer_cache.lane == thread_lane) {
+			return *static_cast<LaneBuffer*>(buffer_cache.buffer);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		LaneBuffer* result = nullptr;
+		for (std::unique_ptr<LaneBuffer>& buffer : buffers) {
+			if (buffer->lane == thread_lane) {
+				result = buffer.get();
+			}
+		}
+		if (!result) {
+			buffers.push_back(std::make_unique<LaneBuffer>());
+			result = buffers.back().get();
+			result->lane = thread_lane;
+		}
+		buffer_cache = { id, thread_lane, result };
+		return *result;
+	}
+
+	void Recorder::record(const Event& event) {
+		LaneBuffer& buffer = get_buffer();
+		if (buffer.events.size() < buffer_capacity) {
+			buffer.events.push_back(event);
+			return;
+		}
+		if (buffer.events.empty()) {
+			buffer.dropped++;
+			return;
+		}
+		buffer.events[buffer.next] = event;
+		buffer.next = (buffer.next + 1) % buffer.events.size();
+		buffer.dropped++;
+	}
+
+	void Recorder::instant(const char* name, const char* category, const char* arg_name, Int64Type arg_value) {
+		Event event;
+		event.name = name;
+		event.category = category;
+		event.phase = 'i';
+		event.begin_ns = now();
+		if (arg_name) {
+			event.arg_count = 1;
+			event.arg_names[0] = arg_name;
+			event.arg_values[0] = arg_value;
+		}
+		record(event);
+	}
+
+	ProgramCounterType Recorder::get_event_count() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		ProgramCounterType result = 0;
+		for (const std::unique_ptr<LaneBuffer>& buffer : buffers) {
+			result += buffer->events.size();
+		}
+		return result;
+	}
+
+	ProgramCounterType Recorder::get_dropped_count() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		ProgramCounterType result = 0;
+		for (const std::unique_ptr<LaneBuffer>& buffer : buffers) {
+			result += buffer->dropped;
+		}
+		return result;
+	}
+
+	static void write_timestamp(std::ostream& stream, Int64Type ns) {
+		// trace timestamps are microseconds
+		stream << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000;
+	}
+
+	// Recording threads have to be finished, buffers are read without their owners.
+	void Recorder::write_chrome_json(std::ostream& stream) const {
+		std::lock_guard<std::mutex> lock(mutex);
+		ProgramCounterType dropped = 0;
+		bool first = true;
+		auto separator = [&]() {
+			stream << (first ? "\n" : ",\n");
+			first = false;
+		};
+		stream << "{\"traceEvents\":[";
+		for (const std::unique_ptr<LaneBuffer>& buffer : buffers) {
+			separator();
+			stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->lane << ",\"args\":{\"name\":\"";
+			if (buffer->lane == 0) {
+				stream << "main";
+			} else {
+				stream << "worker " << buffer->lane;
+			}
+			stream << "\"}}";
+			dropped += buffer->dropped;
+			for (ProgramCounterType event_i = 0; event_i < buffer->events.size(); event_i++) {
+				const Event& event = buffer->events[(buffer->next + event_i) % buffer->events.size()];
+				separator();
+				stream << "{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category << "\",\"ph\":\"" << event.phase << "\"";
+				stream << ",\"pid\":1,\"tid\":" << buffer->lane << ",\"ts\":";
+				write_timestamp(stream, event.begin_ns);
+				if (event.phase == 'X') {
+					stream << ",\"dur\":";
+					write_timestamp(stream, event.duration_ns);
+				} else if (event.phase == 'i') {
+					stream << ",\"s\":\"t\"";
+				}
+				if (event.arg_count > 0) {
+					stream << ",\"args\":{";
+					for (ProgramCounterType arg_i = 0; arg_i < event.arg_count; arg_i++) {
+						stream << (arg_i > 0 ? "," : "") << "\"" << event.arg_names[arg_i] << "\":" << event.arg_values[arg_i];
+					}
+					stream << "}";
+				}
+				stream << "}";
+			}
+		}
+		stream << "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":\"" << dropped << "\"}}\n";
+	}
+
+	void Recorder::save(std::string path) const {
+		std::ofstream file(path, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Cannot open trace file " + path);
+		}
+		write_chrome_json(file);
+	}
+
+	Scope::Scope(Recorder* recorder, const char* name, const char* category) {
+		this->recorder = recorder;
+		if (recorder) {
+			event.name = name;
+			event.category = category;
+			event.begin_ns = recorder->now();
+		}
+	}
+
+	Scope::~Scope() {
+		end();
+	}
+
+	void Scope::arg(const char* name, Int64Type value) {
+		if (!recorder || event.arg_count >= 2) {
+			return;
+		}
+		event.arg_names[event.arg_count] = name;
+		event.arg_values[event.arg_count] = value;
+		event.arg_count++;
+	}
+
+	void Scope::end() {
+		if (!recorder) {
+			return;
+		}
+		event.duration_ns = recorder->now() - event.begin_ns;
+		recorder->record(event);
+		recorder = nullptr;
+	}
+
+	void Scope::discard() {
+		recorder = nullptr;
+	}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "types.h"
+
+// Timeline of interpreter events in the Chrome trace event format, which chrome://tracing and Perfetto open.
+// Every thread records into its own ring buffer, so recording takes no lock and memory stays bounded,
+// the oldest events of a thread are dropped once its buffer is full.
+namespace trace {
+
+	// names are not copied, they have to be string literals
+	struct Event {
+		const char* name = nullptr;
+		const char* category = nullptr;
+		// 'X' for a span with a duration, 'i' for an instant
+		char phase = 'X';
+		Int64Type begin_ns = 0;
+		Int64Type duration_ns = 0;
+		ProgramCounterType arg_count = 0;
+		const char* arg_names[2] = {};
+		Int64Type arg_values[2] = {};
+	};
+
+	// Buffers belong to lanes, which are the tid of their events. Threads record into lane 0
+	// until they pick another one, a lane is used by one thread at a time.
+	void set_thread_lane(ProgramCounterType lane);
+
+	class Recorder {
+	public:
+		// events kept per lane
+		ProgramCounterType buffer_capacity = 1 << 16;
+		Recorder();
+		Int64Type now() const;
+		void record(const Event& event);
+		void instant(const char* name, const char* category, const char* arg_name = nullptr, Int64Type arg_value = 0);
+		ProgramCounterType get_event_count() const;
+		ProgramCounterType get_dropped_count() const;
+		void write_chrome_json(std::ostream& stream) const;
+		void save(std::string path) const;
+
+	private:
+		struct LaneBuffer {
+			ProgramCounterType lane = 0;
+			std::vector<Event> events;
+			// oldest event once the buffer is full
+			ProgramCounterType next = 0;
+			ProgramCounterType dropped = 0;
+		};
+		std::chrono::steady_clock::time_point start;
+		// tells recorders apart in the thread local buffer cache, addresses can be reused
+		Uint64Type id;
+		mutable std::mutex mutex;
+		std::vector<std::unique_ptr<LaneBuffer>> buffers;
+		LaneBuffer& get_buffer();
+	};
+
+	// Records a span from construction to end or destruction, does nothing without a recorder.
+	class Scope {
+	public:
+		Scope(Recorder* recorder, const char* name, const char* category);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		// at most two args per span
+		void arg(const char* name, Int64Type value);
+		void end();
+		// drops the span without recording it
+		void discard();
+
+	private:
+		Recorder* recorder;
+		Event event;
+	};
+
+}
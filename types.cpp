@@ -17,6 +17,8 @@ token_type string_to_type(std::string str) {
 		return type_instr;
 	} else if (str == "ptr") {
 		return type_ptr;
+	} else if (str == "object") {
+		return type_object;
 	} else {
 		return type_unknown;
 	}
@@ -32,6 +34,7 @@ std::string type_to_string(token_type type) {
 		case type_double: return "double"; break;
 		case type_instr: return "instr"; break;
 		case type_ptr: return "ptr"; break;
+		case type_object: return "object"; break;
 		default: return "unknown";
 	}
 }
\ No newline at end of file
@@ -55,6 +55,7 @@ enum token_type {
 	type_double,
 	type_instr,
 	type_ptr,
+	type_object,
 	type_unknown, // keep last
 };
 
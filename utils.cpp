@@ -283,4 +283,16 @@ namespace utils {
 		return result;
 	}
 
+	LongNumberType hash_mix(LongNumberType value) {
+		// splitmix64 finalizer
+		value += 0x9E3779B97F4A7C15ULL;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+		return value ^ (value >> 31);
+	}
+
+	LongNumberType hash_combine(LongNumberType first, LongNumberType second) {
+		return hash_mix(first ^ hash_mix(second));
+	}
+
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <format>
 #include <filesystem>
 #include <fstream>
+#include <cmath>
+#include <type_traits>
 
 namespace utils {
 
@@ -45,10 +47,23 @@ namespace utils {
 	std::string replace_escape_seq(std::string str);
 	bool alphanum_less(std::string str1, std::string str2);
 	std::vector<std::filesystem::path> list_directory(std::filesystem::path path, bool alphanum = false);
+	LongNumberType hash_mix(LongNumberType value);
+	LongNumberType hash_combine(LongNumberType first, LongNumberType second);
 
+	// result has the sign of b, integers are computed exactly without converting to double
 	template <typename T>
 	T mod(T a, T b) {
-		return std::fmod((std::fmod(a, b) + b), b);
+		if constexpr (std::is_floating_point_v<T>) {
+			return std::fmod((std::fmod(a, b) + b), b);
+		} else if constexpr (std::is_signed_v<T>) {
+			if (b == -1) {
+				return 0;
+			}
+			T result = a % b;
+			return result != 0 && (result < 0) != (b < 0) ? result + b : result;
+		} else {
+			return a % b;
+		}
 	}
 
 }
\ No newline at end of file
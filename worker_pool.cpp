@@ -0,0 +1,63 @@
+#include "worker_pool.h"
+#include "trace.h"
+
+WorkerPool::WorkerPool(ProgramCounterType thread_count) {
+	for (ProgramCounterType thread_i = 0; thread_i < thread_count; thread_i++) {
+		threads.push_back(std::thread(&WorkerPool::work, this, thread_i));
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	job_started.notify_all();
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+ProgramCounterType WorkerPool::get_thread_count() const {
+	return threads.size();
+}
+
+void WorkerPool::run(ProgramCounterType count, const std::function<void(ProgramCounterType)>& task) {
+	if (count == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> run_lock(run_mutex);
+	std::unique_lock<std::mutex> lock(mutex);
+	this->task = &task;
+	task_count = count;
+	next_index = 0;
+	generation++;
+	busy_count = threads.size();
+	job_started.notify_all();
+	job_finished.wait(lock, [&]() { return busy_count == 0; });
+	this->task = nullptr;
+}
+
+void WorkerPool::work(ProgramCounterType thread_i) {
+	trace::set_thread_lane(thread_i + 1);
+	Uint64Type seen_generation = 0;
+	while (true) {
+		std::unique_lock<std::mutex> lock(mutex);
+		job_started.wait(lock, [&]() { return stopping || generation != seen_generation; });
+		if (stopping) {
+			return;
+		}
+		seen_generation = generation;
+		const std::function<void(ProgramCounterType)>& current_task = *task;
+		ProgramCounterType count = task_count;
+		lock.unlock();
+		for (ProgramCounterType index = next_index++; index < count; index = next_index++) {
+			current_task(index);
+		}
+		lock.lock();
+		busy_count--;
+		if (busy_count == 0) {
+			job_finished.notify_one();
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "types.h"
+
+// Threads that stay alive between jobs, so a job costs a wakeup instead of starting threads.
+// Every worker records trace events into the lane of its index plus one.
+class WorkerPool {
+public:
+	WorkerPool(ProgramCounterType thread_count);
+	~WorkerPool();
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	ProgramCounterType get_thread_count() const;
+	// Calls task for every index below count on the workers and returns once all calls returned,
+	// task must not throw. Jobs from different threads run one after another.
+	void run(ProgramCounterType count, const std::function<void(ProgramCounterType)>& task);
+
+private:
+	std::vector<std::thread> threads;
+	std::mutex run_mutex;
+	std::mutex mutex;
+	std::condition_variable job_started;
+	std::condition_variable job_finished;
+	const std::function<void(ProgramCounterType)>* task = nullptr;
+	ProgramCounterType task_count = 0;
+	std::atomic<ProgramCounterType> next_index = 0;
+	// tells workers that a new job started, a worker that woke up late does not run a job twice
+	Uint64Type generation = 0;
+	ProgramCounterType busy_count = 0;
+	bool stopping = false;
+	void work(ProgramCounterType thread_i);
+};